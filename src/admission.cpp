@@ -0,0 +1,224 @@
+/******************************************************************************
+ Copyright 2026 Allied Telesis Labs Ltd. All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+    1. Redistributions of source code must retain the above copyright notice,
+       this list of conditions and the following disclaimer.
+
+    2. Redistributions in binary form must reproduce the above copyright
+       notice, this list of conditions and the following disclaimer in the
+       documentation and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*******************************************************************************/
+
+#include "admission.hpp"
+#include "exceptions.hpp"
+#include <algorithm>
+#include <cstdlib>
+#include <fstream>
+#include <thread>
+#include <utility>
+
+using namespace buildsys;
+
+// Memory stall percentages (over the last 10 seconds) considered to be pressure
+static const double memory_some_high = 10.0;
+static const double memory_full_high = 2.0;
+static const double memory_some_low = 1.0;
+// CPU stall percentages considered to be saturated, and to leave room for more
+static const double cpu_some_high = 60.0;
+static const double cpu_some_low = 20.0;
+// Load average per cpu considered to be overloaded
+static const double load_high = 1.5;
+
+constexpr std::chrono::seconds AdmissionControl::interval;
+
+/**
+ * Read the 10 second average from a pressure stall information file.
+ *
+ * @param path - The file to read, e.g. /proc/pressure/memory.
+ * @param kind - The line to read, either "some" or "full".
+ *
+ * @returns The average, or 0 if it isn't available.
+ */
+static double read_pressure(const std::string &path, const std::string &kind)
+{
+	std::ifstream file(path);
+	std::string word;
+	while(file >> word) {
+		if(word != kind) {
+			continue;
+		}
+		if(file >> word && word.compare(0, 6, "avg10=") == 0) {
+			const char *value = word.c_str() + 6;
+			char *end = nullptr;
+			double avg = strtod(value, &end);
+			// A truncated or garbled reading is treated as unavailable
+			return (end != value && *end == '\0') ? avg : 0;
+		}
+	}
+	return 0;
+}
+
+/**
+ * Construct the AdmissionControl. The limit starts at the lower bound and is raised
+ * while the host has capacity.
+ *
+ * @param _min_limit - The fewest packages that may build at once.
+ * @param _max_limit - The most packages that may build at once.
+ * @param _proc_path - Where procfs is mounted.
+ */
+AdmissionControl::AdmissionControl(int _min_limit, int _max_limit, std::string _proc_path)
+    : min_limit(_min_limit), max_limit(_max_limit), limit(_min_limit),
+      cpus(std::max(std::thread::hardware_concurrency(), 1U)),
+      proc_path(std::move(_proc_path))
+{
+	if(this->min_limit < 1 || this->max_limit < this->min_limit) {
+		throw CustomException("Adaptive package limits must satisfy 1 <= min <= max");
+	}
+}
+
+/**
+ * Set where decisions are recorded.
+ *
+ * @param _logger - The logger to record limit changes with.
+ */
+void AdmissionControl::setLogger(Logger *_logger)
+{
+	this->logger = _logger;
+}
+
+/**
+ * Sample the pressure on the host. Pressure that the kernel doesn't report is
+ * treated as none.
+ *
+ * @returns The readings.
+ */
+AdmissionControl::Sample AdmissionControl::sample() const
+{
+	Sample s;
+	s.memory_some = read_pressure(this->proc_path + "/pressure/memory", "some");
+	s.memory_full = read_pressure(this->proc_path + "/pressure/memory", "full");
+	s.cpu_some = read_pressure(this->proc_path + "/pressure/cpu", "some");
+
+	std::ifstream loadavg(this->proc_path + "/loadavg");
+	if(!(loadavg >> s.loadavg)) {
+		s.loadavg = 0;
+	}
+	return s;
+}
+
+/**
+ * Change the limit, recording the decision.
+ *
+ * @param new_limit - The limit to change to.
+ * @param sample - The readings that caused the change.
+ * @param reason - Why the limit is changing.
+ */
+void AdmissionControl::adjust(int new_limit, const Sample &sample,
+                              const std::string &reason)
+{
+	new_limit = std::min(std::max(new_limit, this->min_limit), this->max_limit);
+	if(new_limit == this->limit) {
+		return;
+	}
+
+	if(new_limit > this->limit) {
+		this->raised++;
+	} else {
+		this->lowered++;
+	}
+
+	if(this->logger != nullptr) {
+		this->logger->log(boost::format{"Package limit %1% -> %2% (%3%): memory some "
+		                                "%4%%% full %5%%%, cpu some %6%%%, load %7%"} %
+		                  this->limit % new_limit % reason % sample.memory_some %
+		                  sample.memory_full % sample.cpu_some % sample.loadavg);
+	}
+	this->limit = new_limit;
+}
+
+/**
+ * Update the limit, sampling the host if the last sample is old enough.
+ *
+ * @param now - The current time.
+ *
+ * @returns The number of packages that may build at once.
+ */
+int AdmissionControl::update(std::chrono::steady_clock::time_point now)
+{
+	if(this->sampled && now - this->last_sample < AdmissionControl::interval) {
+		return this->limit;
+	}
+	this->sampled = true;
+	this->last_sample = now;
+
+	Sample s = this->sample();
+	double load_per_cpu = s.loadavg / this->cpus;
+
+	if(s.memory_full >= memory_full_high) {
+		// Tasks are completely stalled on memory, back off quickly before the OOM killer
+		this->adjust(this->limit / 2, s, "memory stalled");
+	} else if(s.memory_some >= memory_some_high) {
+		this->adjust(this->limit - 1, s, "memory pressure");
+	} else if(s.cpu_some >= cpu_some_high || load_per_cpu >= load_high) {
+		this->adjust(this->limit - 1, s, "cpu overloaded");
+	} else if(s.memory_some < memory_some_low && s.cpu_some < cpu_some_low &&
+	          load_per_cpu < 1.0) {
+		this->adjust(this->limit + 1, s, "idle capacity");
+	}
+
+	return this->limit;
+}
+
+/**
+ * Get the number of packages that may currently build at once.
+ *
+ * @returns The limit.
+ */
+int AdmissionControl::getLimit() const
+{
+	return this->limit;
+}
+
+/**
+ * Get the upper bound on the limit.
+ *
+ * @returns The upper bound.
+ */
+int AdmissionControl::getMaxLimit() const
+{
+	return this->max_limit;
+}
+
+/**
+ * Get how many times the limit has been raised.
+ *
+ * @returns The count.
+ */
+int AdmissionControl::getRaised() const
+{
+	return this->raised;
+}
+
+/**
+ * Get how many times the limit has been lowered.
+ *
+ * @returns The count.
+ */
+int AdmissionControl::getLowered() const
+{
+	return this->lowered;
+}
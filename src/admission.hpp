@@ -0,0 +1,81 @@
+/******************************************************************************
+ Copyright 2026 Allied Telesis Labs Ltd. All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+    1. Redistributions of source code must retain the above copyright notice,
+       this list of conditions and the following disclaimer.
+
+    2. Redistributions in binary form must reproduce the above copyright
+       notice, this list of conditions and the following disclaimer in the
+       documentation and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*******************************************************************************/
+
+#ifndef ADMISSION_HPP_
+#define ADMISSION_HPP_
+
+#include "logger.hpp"
+#include <chrono>
+#include <string>
+
+namespace buildsys
+{
+	/**
+	 * Decides how many packages may build at once from the load on the host. The
+	 * memory and cpu pressure (PSI) and the load average are sampled periodically,
+	 * the limit is lowered while the host is under pressure and raised while it is
+	 * idle, staying within the configured bounds. Every change is logged.
+	 */
+	class AdmissionControl
+	{
+	public:
+		//! Pressure readings from one sample of the host
+		struct Sample {
+			double memory_some{0};
+			double memory_full{0};
+			double cpu_some{0};
+			double loadavg{0};
+		};
+
+	private:
+		int min_limit;
+		int max_limit;
+		int limit;
+		unsigned int cpus;
+		std::string proc_path;
+		std::chrono::steady_clock::time_point last_sample;
+		bool sampled{false};
+		int raised{0};
+		int lowered{0};
+		Logger *logger{nullptr};
+
+		void adjust(int new_limit, const Sample &sample, const std::string &reason);
+
+	public:
+		AdmissionControl(int _min_limit, int _max_limit, std::string _proc_path = "/proc");
+		void setLogger(Logger *_logger);
+		Sample sample() const;
+		int update(std::chrono::steady_clock::time_point now);
+		int getLimit() const;
+		int getMaxLimit() const;
+		int getRaised() const;
+		int getLowered() const;
+
+		//! How often the host is sampled
+		static constexpr std::chrono::seconds interval{2};
+	};
+} // namespace buildsys
+
+#endif // ADMISSION_HPP_
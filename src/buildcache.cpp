@@ -0,0 +1,502 @@
+/******************************************************************************
+ Copyright 2026 Allied Telesis Labs Ltd. All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+    1. Redistributions of source code must retain the above copyright notice,
+       this list of conditions and the following disclaimer.
+
+    2. Redistributions in binary form must reproduce the above copyright
+       notice, this list of conditions and the following disclaimer in the
+       documentation and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*******************************************************************************/
+
+#include "buildcache.hpp"
+#include "exceptions.hpp"
+#include "hash.hpp"
+#include "logger.hpp"
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+#include <sys/stat.h>
+#include <thread>
+
+using namespace buildsys;
+
+/**
+ * Construct a BuildCache.
+ *
+ * @param _url - The URL of the cache server, which must be http://.
+ * @param connections - The most connections to have open to the server at once.
+ */
+BuildCache::BuildCache(const std::string &_url, size_t connections)
+{
+	if(!HttpUrl::parse(_url, &this->url)) {
+		throw CustomException("Unsupported build cache URL: " + _url);
+	}
+	this->pool = std::make_unique<HttpPool>(this->url.host, this->url.port, connections);
+}
+
+/**
+ * Check whether a build cache URL can be used by this client.
+ *
+ * @param _url - The URL of the cache server.
+ *
+ * @returns true if it can be, false otherwise.
+ */
+bool BuildCache::supported(const std::string &_url)
+{
+	HttpUrl parsed;
+	return HttpUrl::parse(_url, &parsed);
+}
+
+/**
+ * Get the path on the server of a file stored for a package.
+ *
+ * @param key - The package, as <namespace>/<package>/<build info hash>.
+ * @param file - The name of the file.
+ *
+ * @returns The path.
+ */
+std::string BuildCache::path(const std::string &key, const std::string &file) const
+{
+	return this->url.path + "/" + key + "/" + file;
+}
+
+/**
+ * Find out which packages the cache has the outputs of, asking about them all at once
+ * over every connection. A package is available once its "usable" marker is.
+ *
+ * @param keys - The packages, each as <namespace>/<package>/<build info hash>.
+ *
+ * @returns The availability of each package, in the same order.
+ */
+std::vector<BuildCache::Availability>
+BuildCache::probe(const std::vector<std::string> &keys)
+{
+	std::vector<Availability> results(keys.size(), Availability::Unknown);
+	std::atomic<size_t> next{0};
+
+	auto worker = [this, &keys, &results, &next] {
+		std::unique_ptr<HttpConnection> connection = this->pool->take();
+		for(size_t i = next++; i < keys.size(); i = next++) {
+			int status = connection->request("HEAD", this->path(keys[i], "usable"));
+			if(status >= 200 && status < 300) {
+				results[i] = Availability::Hit;
+			} else if(status == 404 || status == 410) {
+				results[i] = Availability::Miss;
+			}
+		}
+		this->pool->give(std::move(connection));
+	};
+
+	std::vector<std::thread> threads;
+	size_t thread_count = std::min(this->pool->size(), keys.size());
+	for(size_t i = 0; i < thread_count; i++) {
+		threads.emplace_back(worker);
+	}
+	for(auto &thread : threads) {
+		thread.join();
+	}
+	return results;
+}
+
+/**
+ * Make a GET request over a connection from the pool.
+ *
+ * @param _path - The path to get.
+ * @param sink - Where to pass the body.
+ *
+ * @returns The response status, or -1 if the request failed.
+ */
+int BuildCache::get(const std::string &_path, const HttpConnection::BodySink &sink)
+{
+	std::unique_ptr<HttpConnection> connection = this->pool->take();
+	int status = connection->request("GET", _path, sink);
+	this->pool->give(std::move(connection));
+	return status;
+}
+
+//! Is a response status worth trying again ?
+static bool transient(int status)
+{
+	return status < 0 || status == 408 || status == 429 || status >= 500;
+}
+
+//! Wait before trying a request again
+static void back_off(int attempt)
+{
+	std::this_thread::sleep_for(std::chrono::milliseconds(250 << attempt));
+}
+
+/**
+ * Get the expected digests of the files stored for a package.
+ *
+ * @param key - The package, as <namespace>/<package>/<build info hash>.
+ * @param digests - Filled with the digest of each file, if the server has them.
+ * @param error - Set to the reason for failing.
+ *
+ * @returns true if the digests were fetched or there are none, false otherwise.
+ */
+bool BuildCache::getDigests(const std::string &key,
+                            std::map<std::string, std::string> *digests,
+                            std::string *error)
+{
+	for(int attempt = 0; attempt < BuildCache::attempts; attempt++) {
+		std::string body;
+		int status = this->get(this->path(key, "SHA256SUMS"),
+		                       [&body](const char *data, size_t length) {
+			                       body.append(data, length);
+			                       return true;
+		                       });
+		if(status == 404) {
+			return true;
+		}
+		if(status >= 200 && status < 300) {
+			// <digest>  <file> (or <digest> *<file>)
+			std::istringstream lines(body);
+			std::string digest;
+			std::string file;
+			while(lines >> digest >> file) {
+				(*digests)[(file[0] == '*') ? file.substr(1) : file] = digest;
+			}
+			return true;
+		}
+		if(!transient(status)) {
+			*error = "SHA256SUMS: HTTP " + std::to_string(status);
+			return false;
+		}
+		back_off(attempt);
+	}
+	*error = "SHA256SUMS: No response";
+	return false;
+}
+
+/**
+ * Download a file, writing it to disk as it is received and checking its digest
+ * if it is known.
+ *
+ * @param key - The package, as <namespace>/<package>/<build info hash>.
+ * @param item - The file, and where to put it.
+ * @param digests - The expected digests of the files.
+ * @param error - Set to the reason for failing.
+ *
+ * @returns true if the file was downloaded, false otherwise.
+ */
+bool BuildCache::download(const std::string &key, const Download &item,
+                          const std::map<std::string, std::string> &digests,
+                          std::string *error)
+{
+	std::string partial = item.dest + ".part";
+	for(int attempt = 0; attempt < BuildCache::attempts; attempt++) {
+		std::ofstream out(partial, std::ios::binary | std::ios::trunc);
+		if(!out.is_open()) {
+			*error = "Could not write " + partial;
+			return false;
+		}
+		Hasher hasher;
+		int status = this->get(this->path(key, item.file),
+		                       [&out, &hasher](const char *data, size_t length) {
+			                       hasher.update(data, length);
+			                       out.write(data, static_cast<std::streamsize>(length));
+			                       return out.good();
+		                       });
+		out.close();
+
+		if(status >= 200 && status < 300) {
+			auto expected = digests.find(item.file);
+			if(expected == digests.end() || expected->second == hasher.finish()) {
+				if(std::rename(partial.c_str(), item.dest.c_str()) == 0) {
+					error->clear();
+					return true;
+				}
+				*error = "Could not write " + item.dest;
+				break;
+			}
+			*error = item.file + ": Digest mismatch";
+		} else if(transient(status)) {
+			*error = item.file + ": " +
+			         ((status < 0) ? "No response" : "HTTP " + std::to_string(status));
+		} else {
+			*error = item.file + ": HTTP " + std::to_string(status);
+			break;
+		}
+		back_off(attempt);
+	}
+	std::remove(partial.c_str());
+	return false;
+}
+
+/**
+ * Fetch files stored for a package, all at once. Failed requests are tried again
+ * unless the server says the file is not there.
+ *
+ * @param key - The package, as <namespace>/<package>/<build info hash>.
+ * @param downloads - The files, and where to put them.
+ * @param error - Set to the reason for failing.
+ *
+ * @returns true if every file was fetched, false otherwise.
+ */
+bool BuildCache::fetch(const std::string &key, const std::vector<Download> &downloads,
+                       std::string *error)
+{
+	std::map<std::string, std::string> digests;
+	if(!this->getDigests(key, &digests, error)) {
+		return false;
+	}
+
+	std::vector<std::string> errors(downloads.size());
+	std::vector<std::thread> threads;
+	for(size_t i = 0; i < downloads.size(); i++) {
+		threads.emplace_back([this, &key, &downloads, &digests, &errors, i] {
+			this->download(key, downloads[i], digests, &errors[i]);
+		});
+	}
+	for(auto &thread : threads) {
+		thread.join();
+	}
+
+	for(size_t i = 0; i < downloads.size(); i++) {
+		if(!errors[i].empty()) {
+			*error = errors[i];
+			return false;
+		}
+	}
+	return true;
+}
+
+/**
+ * Store data on the server, trying again if the request fails for a reason that
+ * might pass.
+ *
+ * @param connection - The connection to use.
+ * @param _path - The path to store the data at.
+ * @param source - Where to get the data from.
+ * @param length - The length of the data.
+ * @param error - Set to the reason for failing.
+ *
+ * @returns true if the data was stored, false otherwise.
+ */
+bool BuildCache::put(HttpConnection *connection, const std::string &_path,
+                     const HttpConnection::BodySource &source, size_t length,
+                     std::string *error)
+{
+	for(int attempt = 0; attempt < BuildCache::attempts; attempt++) {
+		int status = connection->request("PUT", _path, nullptr, source, length);
+		if(status >= 200 && status < 300) {
+			return true;
+		}
+		*error = (status < 0) ? "No response" : "HTTP " + std::to_string(status);
+		if(!transient(status)) {
+			return false;
+		}
+		back_off(attempt);
+	}
+	return false;
+}
+
+/**
+ * Store a file on the server, working out its digest as it is sent.
+ *
+ * @param connection - The connection to use.
+ * @param key - The package, as <namespace>/<package>/<build info hash>.
+ * @param item - The file, and where it is now.
+ * @param digest - Set to the digest of the file.
+ * @param error - Set to the reason for failing.
+ *
+ * @returns true if the file was stored, false otherwise.
+ */
+bool BuildCache::putFile(HttpConnection *connection, const std::string &key,
+                         const Upload &item, std::string *digest, std::string *error)
+{
+	struct stat before = {};
+	std::ifstream in(item.source, std::ios::binary);
+	if(!in.is_open() || stat(item.source.c_str(), &before) != 0) {
+		*error = "Could not read " + item.source;
+		return false;
+	}
+
+	std::unique_ptr<Hasher> hasher;
+	auto source = [&in, &hasher](size_t offset, char *data, size_t length) {
+		// The whole file is sent again when the request is retried
+		if(offset == 0) {
+			hasher = std::make_unique<Hasher>();
+		}
+		in.clear();
+		in.seekg(static_cast<std::streamoff>(offset));
+		in.read(data, static_cast<std::streamsize>(length));
+		auto filled = static_cast<size_t>(in.gcount());
+		hasher->update(data, filled);
+		return filled;
+	};
+	auto length = static_cast<size_t>(before.st_size);
+	if(!this->put(connection, this->path(key, item.file), source, length, error)) {
+		*error = item.file + ": " + *error;
+		return false;
+	}
+
+	// A file rewritten while it was sent may not match its digest
+	struct stat after = {};
+	if(stat(item.source.c_str(), &after) != 0 || after.st_size != before.st_size ||
+	   after.st_mtim.tv_sec != before.st_mtim.tv_sec ||
+	   after.st_mtim.tv_nsec != before.st_mtim.tv_nsec) {
+		*error = item.file + ": Changed while uploading";
+		return false;
+	}
+	*digest = (length == 0) ? Hasher().finish() : hasher->finish();
+	return true;
+}
+
+/**
+ * Store the outputs of a package on the server, one after another over a single
+ * connection. The digests of the files are stored next, then the "usable" marker,
+ * so the package is never found before all of its files are there.
+ *
+ * @param key - The package, as <namespace>/<package>/<build info hash>.
+ * @param uploads - The files, and where they are now.
+ * @param error - Set to the reason for failing.
+ *
+ * @returns true if the package was stored, false otherwise.
+ */
+bool BuildCache::upload(const std::string &key, const std::vector<Upload> &uploads,
+                        std::string *error)
+{
+	std::unique_ptr<HttpConnection> connection = this->pool->take();
+	std::string sums;
+	bool stored = true;
+	for(auto &item : uploads) {
+		std::string digest;
+		if(!this->putFile(connection.get(), key, item, &digest, error)) {
+			stored = false;
+			break;
+		}
+		sums += digest + "  " + item.file + "\n";
+	}
+
+	auto from_string = [](const std::string &data) {
+		return [&data](size_t offset, char *out, size_t length) {
+			return data.copy(out, length, offset);
+		};
+	};
+	const std::string empty;
+	if(stored && !this->put(connection.get(), this->path(key, "SHA256SUMS"),
+	                        from_string(sums), sums.size(), error)) {
+		*error = "SHA256SUMS: " + *error;
+		stored = false;
+	}
+	if(stored && !this->put(connection.get(), this->path(key, "usable"),
+	                        from_string(empty), empty.size(), error)) {
+		*error = "usable: " + *error;
+		stored = false;
+	}
+	this->pool->give(std::move(connection));
+	return stored;
+}
+
+/**
+ * Construct a CacheUploader, starting the threads that upload.
+ *
+ * @param _cache - The build cache to upload to.
+ * @param threads - How many packages to upload at once.
+ * @param _capacity - The most packages to queue.
+ */
+CacheUploader::CacheUploader(BuildCache *_cache, size_t threads, size_t _capacity)
+    : cache(_cache), capacity(_capacity)
+{
+	for(size_t i = 0; i < std::max<size_t>(threads, 1); i++) {
+		this->workers.emplace_back([this] { this->work(); });
+	}
+}
+
+/**
+ * Destroy the CacheUploader, waiting for the queued uploads.
+ */
+CacheUploader::~CacheUploader()
+{
+	this->finish();
+}
+
+/**
+ * Upload queued packages until told to finish and there are none left.
+ */
+void CacheUploader::work()
+{
+	std::unique_lock<std::mutex> lk(this->lock);
+	while(true) {
+		this->cond.wait(lk, [this] { return !this->queue.empty() || this->finishing; });
+		if(this->queue.empty()) {
+			return;
+		}
+		Job job = std::move(this->queue.front());
+		this->queue.pop_front();
+		lk.unlock();
+
+		std::string error;
+		bool stored = this->cache->upload(job.key, job.uploads, &error);
+		if(!stored) {
+			Logger logger("BuildCache");
+			logger.log("Failed to upload " + job.key + ": " + error);
+		}
+
+		lk.lock();
+		if(stored) {
+			this->uploaded++;
+		} else {
+			this->failed++;
+		}
+	}
+}
+
+/**
+ * Queue the outputs of a package to be uploaded, without waiting.
+ *
+ * @param key - The package, as <namespace>/<package>/<build info hash>.
+ * @param uploads - The files, and where they are now.
+ *
+ * @returns true if the package is queued (or already was), false if the queue is full.
+ */
+bool CacheUploader::add(const std::string &key, std::vector<BuildCache::Upload> uploads)
+{
+	std::unique_lock<std::mutex> lk(this->lock);
+	if(this->queued.count(key) != 0) {
+		return true;
+	}
+	if(this->finishing || this->queue.size() >= this->capacity) {
+		this->dropped++;
+		return false;
+	}
+	this->queued.insert(key);
+	this->queue.push_back({key, std::move(uploads)});
+	this->cond.notify_one();
+	return true;
+}
+
+/**
+ * Wait for the queued uploads to be done, and stop the threads that upload.
+ */
+void CacheUploader::finish()
+{
+	{
+		std::unique_lock<std::mutex> lk(this->lock);
+		this->finishing = true;
+		this->cond.notify_all();
+	}
+	for(auto &worker : this->workers) {
+		worker.join();
+	}
+	this->workers.clear();
+}
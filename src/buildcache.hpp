@@ -0,0 +1,146 @@
+/******************************************************************************
+ Copyright 2026 Allied Telesis Labs Ltd. All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+    1. Redistributions of source code must retain the above copyright notice,
+       this list of conditions and the following disclaimer.
+
+    2. Redistributions in binary form must reproduce the above copyright
+       notice, this list of conditions and the following disclaimer in the
+       documentation and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*******************************************************************************/
+
+#ifndef BUILDCACHE_HPP_
+#define BUILDCACHE_HPP_
+
+#include "http.hpp"
+#include <condition_variable>
+#include <deque>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace buildsys
+{
+	/**
+	 * A client for the build cache server. Package outputs are stored on the server
+	 * under <url>/<namespace>/<package>/<build info hash>/, optionally along with a
+	 * SHA256SUMS file (in sha256sum format) that downloads are checked against.
+	 * Requests go over a bounded pool of kept open connections, so many can be made at
+	 * once cheaply. Outputs are stored with PUT requests, the "usable" marker last.
+	 */
+	class BuildCache
+	{
+	public:
+		enum class Availability { Unknown, Hit, Miss };
+		//! A file to fetch for a package, and where to put it
+		struct Download {
+			std::string file;
+			std::string dest;
+		};
+		//! A file to store for a package, and where it is now
+		struct Upload {
+			std::string file;
+			std::string source;
+		};
+		//! How many times a request is tried before giving up
+		static const int attempts = 3;
+
+	private:
+		HttpUrl url;
+		std::unique_ptr<HttpPool> pool;
+		int get(const std::string &_path, const HttpConnection::BodySink &sink);
+		bool getDigests(const std::string &key, std::map<std::string, std::string> *digests,
+		                std::string *error);
+		bool download(const std::string &key, const Download &item,
+		              const std::map<std::string, std::string> &digests,
+		              std::string *error);
+		bool put(HttpConnection *connection, const std::string &_path,
+		         const HttpConnection::BodySource &source, size_t length,
+		         std::string *error);
+		bool putFile(HttpConnection *connection, const std::string &key,
+		             const Upload &item, std::string *digest, std::string *error);
+
+	public:
+		BuildCache(const std::string &_url, size_t connections);
+		static bool supported(const std::string &_url);
+		std::string path(const std::string &key, const std::string &file) const;
+		std::vector<Availability> probe(const std::vector<std::string> &keys);
+		bool fetch(const std::string &key, const std::vector<Download> &downloads,
+		           std::string *error);
+		bool upload(const std::string &key, const std::vector<Upload> &uploads,
+		            std::string *error);
+	};
+
+	/**
+	 * Uploads package outputs to the build cache in the background. Packages are queued
+	 * without waiting, and a few threads work through the queue, each using one
+	 * connection, so that most of the connections are left for fetching. When the queue
+	 * is full, packages are not uploaded rather than holding up the build.
+	 */
+	class CacheUploader
+	{
+	private:
+		struct Job {
+			std::string key;
+			std::vector<BuildCache::Upload> uploads;
+		};
+		BuildCache *cache;
+		const size_t capacity;
+		std::deque<Job> queue;
+		//! Every package queued, so that rebuilds aren't uploaded again
+		std::set<std::string> queued;
+		std::vector<std::thread> workers;
+		bool finishing{false};
+		size_t uploaded{0};
+		size_t failed{0};
+		size_t dropped{0};
+		std::mutex lock;
+		std::condition_variable cond;
+		void work();
+
+	public:
+		CacheUploader(BuildCache *_cache, size_t threads, size_t _capacity);
+		~CacheUploader();
+		CacheUploader(const CacheUploader &) = delete;
+		CacheUploader &operator=(const CacheUploader &) = delete;
+		CacheUploader(CacheUploader &&) = delete;
+		CacheUploader &operator=(CacheUploader &&) = delete;
+		bool add(const std::string &key, std::vector<BuildCache::Upload> uploads);
+		void finish();
+		//! How many packages were uploaded
+		size_t getUploaded() const
+		{
+			return this->uploaded;
+		}
+		//! How many packages failed to upload
+		size_t getFailed() const
+		{
+			return this->failed;
+		}
+		//! How many packages were not uploaded because the queue was full
+		size_t getDropped() const
+		{
+			return this->dropped;
+		}
+	};
+} // namespace buildsys
+
+#endif // BUILDCACHE_HPP_
@@ -29,6 +29,7 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 using namespace buildsys;
 
 static std::vector<std::string> ignored_features;
+static std::string hash_algorithm;
 
 /**
  * Set the ignored features for all BuildDescription instances.
@@ -40,6 +41,17 @@ void BuildDescription::set_ignored_features(const std::vector<std::string> &feat
 	ignored_features = features;
 }
 
+/**
+ * Set the algorithm that the hashes in every BuildDescription are worked out with,
+ * to be recorded at the top of them.
+ *
+ * @param name - The name of the algorithm, or empty to leave it unrecorded.
+ */
+void BuildDescription::set_hash_algorithm(const std::string &name)
+{
+	hash_algorithm = name;
+}
+
 /**
  * Add a feature value pair to the BuildDescription.
  *
@@ -54,6 +66,7 @@ void BuildDescription::add_feature_value(const std::string &feature,
 	if(!is_ignored) {
 		auto desc = boost::format{"FeatureValue %1% %2%"} % feature % value;
 		this->BUs.push_back(desc.str());
+		this->features.push_back(feature);
 	}
 }
 
@@ -66,6 +79,7 @@ void BuildDescription::add_nil_feature_value(const std::string &feature)
 {
 	auto desc = boost::format{"FeatureNil %1%"} % feature;
 	this->BUs.push_back(desc.str());
+	this->features.push_back(feature);
 }
 
 /**
@@ -138,6 +152,9 @@ void BuildDescription::add_extraction_info_file(const std::string &fname,
  */
 void BuildDescription::print(std::ostream &out) const
 {
+	if(!hash_algorithm.empty()) {
+		out << "HashAlgorithm " << hash_algorithm << std::endl;
+	}
 	for(auto &unit : this->BUs) {
 		out << unit << std::endl;
 	}
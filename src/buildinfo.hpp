@@ -41,9 +41,11 @@ namespace buildsys
 	{
 	private:
 		std::vector<std::string> BUs;
+		std::vector<std::string> features;
 
 	public:
 		static void set_ignored_features(const std::vector<std::string> &features);
+		static void set_hash_algorithm(const std::string &name);
 		void add_feature_value(const std::string &feature, const std::string &value);
 		void add_nil_feature_value(const std::string &feature);
 		void add_package_file(const std::string &fname, const std::string &hash);
@@ -52,6 +54,11 @@ namespace buildsys
 		void add_build_info_file(const std::string &fname, const std::string &hash);
 		void add_extraction_info_file(const std::string &fname, const std::string &hash);
 		void print(std::ostream &out) const;
+		//! The features whose values (or lack of one) went into this description
+		const std::vector<std::string> &getFeatures() const
+		{
+			return this->features;
+		}
 	};
 } // namespace buildsys
 
@@ -0,0 +1,194 @@
+/******************************************************************************
+ Copyright 2026 Allied Telesis Labs Ltd. All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+    1. Redistributions of source code must retain the above copyright notice,
+       this list of conditions and the following disclaimer.
+
+    2. Redistributions in binary form must reproduce the above copyright
+       notice, this list of conditions and the following disclaimer in the
+       documentation and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*******************************************************************************/
+
+#include "dependencyorder.hpp"
+#include <algorithm>
+
+using namespace buildsys;
+
+/**
+ * Add an id to the end of the order. Any lower ids that are missing are added first.
+ *
+ * @param id - The id to add.
+ */
+void DependencyOrder::addVertex(size_t id)
+{
+	std::unique_lock<std::mutex> lk(this->lock);
+	while(this->position.size() <= id) {
+		this->position.push_back(this->order.size());
+		this->order.push_back(this->position.size() - 1);
+	}
+	this->depends.resize(this->position.size());
+	this->dependents.resize(this->position.size());
+	this->visited.resize(this->position.size());
+	this->reached_from.resize(this->position.size());
+}
+
+/**
+ * Search from an id, marking everything found between it and a bound in the order.
+ *
+ * @param start - The id to search from.
+ * @param bound - The position to search up to (forward) or down to (backward).
+ * @param forward - Follow dependents (true) or dependencies (false).
+ * @param target - An id that should not be reachable, searching forward.
+ * @param found - Filled with the ids found, including start.
+ *
+ * @returns false if target was reached, true otherwise.
+ */
+bool DependencyOrder::search(size_t start, size_t bound, bool forward, size_t target,
+                             std::vector<size_t> *found)
+{
+	std::vector<size_t> stack{start};
+	this->visited[start] = true;
+	found->push_back(start);
+	while(!stack.empty()) {
+		size_t v = stack.back();
+		stack.pop_back();
+		for(auto w : (forward) ? this->dependents[v] : this->depends[v]) {
+			if(this->visited[w]) {
+				continue;
+			}
+			if(forward ? this->position[w] > bound : this->position[w] < bound) {
+				continue;
+			}
+			this->visited[w] = true;
+			this->reached_from[w] = v;
+			found->push_back(w);
+			if(forward && w == target) {
+				return false;
+			}
+			stack.push_back(w);
+		}
+	}
+	return true;
+}
+
+/**
+ * Record that one id depends on another, moving ids in the order as needed.
+ *
+ * @param from - The id that has the dependency.
+ * @param to - The id depended on.
+ * @param loop - Filled with the ids of the loop if the dependency would close one,
+ *               starting and ending with from, each depending on the next.
+ *
+ * @returns false if the dependency would close a loop (and was not added), true
+ *          otherwise.
+ */
+bool DependencyOrder::addDependency(size_t from, size_t to, std::vector<size_t> *loop)
+{
+	std::unique_lock<std::mutex> lk(this->lock);
+
+	if(from == to) {
+		*loop = {from, to};
+		return false;
+	}
+	auto &from_depends = this->depends.at(from);
+	if(std::find(from_depends.begin(), from_depends.end(), to) != from_depends.end()) {
+		return true;
+	}
+
+	size_t lower = this->position[from];
+	size_t upper = this->position.at(to);
+	if(upper > lower) {
+		// Everything that depends on from, and is not already after to, must move
+		// after everything that to depends on
+		std::vector<size_t> after;
+		std::vector<size_t> before;
+		bool acyclic = this->search(from, upper, true, to, &after);
+		if(acyclic) {
+			this->search(to, lower, false, from, &before);
+		} else {
+			// to already depends on from, the chain back from to shows how
+			loop->clear();
+			loop->push_back(from);
+			for(size_t v = to; v != from; v = this->reached_from[v]) {
+				loop->push_back(v);
+			}
+			loop->push_back(from);
+		}
+		for(auto v : after) {
+			this->visited[v] = false;
+		}
+		for(auto v : before) {
+			this->visited[v] = false;
+		}
+		if(!acyclic) {
+			return false;
+		}
+
+		auto by_position = [this](size_t a, size_t b) {
+			return this->position[a] < this->position[b];
+		};
+		std::sort(before.begin(), before.end(), by_position);
+		std::sort(after.begin(), after.end(), by_position);
+		std::vector<size_t> slots;
+		slots.reserve(before.size() + after.size());
+		for(auto v : before) {
+			slots.push_back(this->position[v]);
+		}
+		for(auto v : after) {
+			slots.push_back(this->position[v]);
+		}
+		std::sort(slots.begin(), slots.end());
+		size_t i = 0;
+		for(auto v : before) {
+			this->position[v] = slots[i];
+			this->order[slots[i++]] = v;
+		}
+		for(auto v : after) {
+			this->position[v] = slots[i];
+			this->order[slots[i++]] = v;
+		}
+	}
+
+	from_depends.push_back(to);
+	this->dependents[to].push_back(from);
+	return true;
+}
+
+/**
+ * Get the order.
+ *
+ * @returns Every id, with each one after everything it depends on.
+ */
+std::vector<size_t> DependencyOrder::getOrder() const
+{
+	std::unique_lock<std::mutex> lk(this->lock);
+	return this->order;
+}
+
+/**
+ * Forget every id and dependency.
+ */
+void DependencyOrder::clear()
+{
+	std::unique_lock<std::mutex> lk(this->lock);
+	this->position.clear();
+	this->order.clear();
+	this->depends.clear();
+	this->dependents.clear();
+	this->visited.clear();
+	this->reached_from.clear();
+}
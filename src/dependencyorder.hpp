@@ -0,0 +1,69 @@
+/******************************************************************************
+ Copyright 2026 Allied Telesis Labs Ltd. All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+    1. Redistributions of source code must retain the above copyright notice,
+       this list of conditions and the following disclaimer.
+
+    2. Redistributions in binary form must reproduce the above copyright
+       notice, this list of conditions and the following disclaimer in the
+       documentation and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*******************************************************************************/
+
+#ifndef DEPENDENCYORDER_HPP_
+#define DEPENDENCYORDER_HPP_
+
+#include <mutex>
+#include <vector>
+
+namespace buildsys
+{
+	/**
+	 * A topological order of dense ids (e.g. package ids) that is kept up to date as
+	 * dependencies are added, so that a dependency loop is found by the dependency that
+	 * closes it, and the order is ready as soon as the last dependency is added.
+	 *
+	 * Adding a dependency that the order already satisfies costs nothing. Otherwise only
+	 * the ids between the two positions that are reachable from either end are moved
+	 * (Pearce and Kelly's dynamic topological sort).
+	 */
+	class DependencyOrder
+	{
+	private:
+		//! The position of each id
+		std::vector<size_t> position;
+		//! The id at each position, dependencies first
+		std::vector<size_t> order;
+		//! What each id depends on, and what depends on each id
+		std::vector<std::vector<size_t>> depends;
+		std::vector<std::vector<size_t>> dependents;
+		//! Scratch marks for the searches, always cleared afterwards
+		std::vector<bool> visited;
+		//! The id each search reached each marked id from
+		std::vector<size_t> reached_from;
+		mutable std::mutex lock;
+		bool search(size_t start, size_t bound, bool forward, size_t target,
+		            std::vector<size_t> *found);
+
+	public:
+		void addVertex(size_t id);
+		bool addDependency(size_t from, size_t to, std::vector<size_t> *loop);
+		std::vector<size_t> getOrder() const;
+		void clear();
+	};
+} // namespace buildsys
+
+#endif // DEPENDENCYORDER_HPP_
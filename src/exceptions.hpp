@@ -49,6 +49,23 @@ namespace buildsys
 		}
 	};
 
+	/**
+	 * A dependency that would make a package depend on itself
+	 */
+	class DependencyLoopException : public CustomException
+	{
+	public:
+		/**
+		 * Construct a DependencyLoopException
+		 *
+		 * @param path - The packages in the loop, in dependency order
+		 */
+		explicit DependencyLoopException(const std::string &path)
+		    : CustomException("Dependency Loop Detected: " + path)
+		{
+		}
+	};
+
 	/**
 	 * A no such key fault
 	 */
@@ -243,3 +243,23 @@ bool FetchedFileCopyExtractionUnit::extract(Package *P)
 
 	return true;
 }
+
+FetchedTreeExtractionUnit::FetchedTreeExtractionUnit(FetchUnit *_fetched)
+{
+	this->fetched = _fetched;
+	this->uri = _fetched->relative_path();
+}
+
+std::string FetchedTreeExtractionUnit::HASH()
+{
+	if(this->hash.empty()) {
+		this->hash = this->fetched->HASH();
+	}
+	return this->hash;
+}
+
+bool FetchedTreeExtractionUnit::extract([[maybe_unused]] Package *P)
+{
+	// The fetch unit has already linked or copied it in
+	return true;
+}
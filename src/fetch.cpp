@@ -166,7 +166,7 @@ bool DownloadFetch::fetch(BuildDir *) // NOLINT
 
 	if(this->hash.length() != 0) {
 		auto fpath = boost::format{"%1%/dl/%2%"} % this->P->getPwd() % this->final_name();
-		std::string _hash = hash_file(fpath.str());
+		std::string _hash = hash_file(fpath.str(), HashAlgorithm::SHA256);
 
 		if(this->hash != _hash) {
 			this->P->log(boost::format{
@@ -193,6 +193,39 @@ std::string DownloadFetch::HASH()
 	return this->hash;
 }
 
+/**
+ * Hash the file/directory, so that the package is only rebuilt when it changes. If
+ * it can't be hashed (e.g. it doesn't exist yet) the package is always rebuilt.
+ *
+ * @returns The Merkle hash of the file/directory, or an empty string.
+ */
+std::string TreeFetch::HASH()
+{
+	if(this->hash.empty()) {
+		std::string path = P->relative_fetch_path(this->fetch_uri);
+		this->hash = hash_merkle(path);
+		if(this->hash.empty()) {
+			P->log(boost::format{"Could not hash %1%, considering code updated"} % path);
+			P->setCodeUpdated();
+		}
+	}
+	return this->hash;
+}
+
+std::string TreeFetch::relative_path()
+{
+	auto position = this->fetch_uri.rfind('/');
+	auto path = std::string("");
+
+	if(position != std::string::npos) {
+		path = this->fetch_uri.substr(position + 1);
+	} else {
+		path = this->fetch_uri;
+	}
+
+	return path;
+}
+
 bool LinkFetch::fetch(BuildDir *d)
 {
 	PackageCmd pc(d->getPath(), "ln");
@@ -223,25 +256,6 @@ bool LinkFetch::fetch(BuildDir *d)
 	return true;
 }
 
-std::string LinkFetch::HASH()
-{
-	return std::string("");
-}
-
-std::string LinkFetch::relative_path()
-{
-	auto position = this->fetch_uri.rfind('/');
-	auto path = std::string("");
-
-	if(position != std::string::npos) {
-		path = this->fetch_uri.substr(position + 1);
-	} else {
-		path = this->fetch_uri;
-	}
-
-	return path;
-}
-
 bool CopyFetch::fetch(BuildDir *d)
 {
 	PackageCmd pc(d->getPath(), "cp");
@@ -252,30 +266,9 @@ bool CopyFetch::fetch(BuildDir *d)
 	if(!pc.Run(this->P->getLogger())) {
 		throw CustomException("Failed to copy (recursively)");
 	}
-	P->log("Copied data in, considering code updated");
-	P->setCodeUpdated();
 	return true;
 }
 
-std::string CopyFetch::HASH()
-{
-	return std::string("");
-}
-
-std::string CopyFetch::relative_path()
-{
-	auto position = this->fetch_uri.rfind('/');
-	auto path = std::string("");
-
-	if(position != std::string::npos) {
-		path = this->fetch_uri.substr(position + 1);
-	} else {
-		path = this->fetch_uri;
-	}
-
-	return path;
-}
-
 void Fetch::add(std::unique_ptr<FetchUnit> fu)
 {
 	this->FUs.push_back(std::move(fu));
@@ -24,99 +24,489 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 *******************************************************************************/
 
 #include "include/buildsys.h"
+#include <numeric>
 
-using namespace boost;
-
+/**
+ * Fill the graph from the packages in every namespace. The dependencies are stored
+ * in compressed sparse row form, both forwards and reversed, indexed by package id.
+ */
 void Internal_Graph::fill()
 {
-	NameSpace::for_each([this](const NameSpace &ns) {
-		ns.for_each_package([this](Package &package) {
-			NodeVertexMap::iterator pos;
-			bool inserted;
-			boost::tie(pos, inserted) =
-			    this->Nodes.insert(std::make_pair(&package, Vertex()));
-			if(inserted) {
-				Vertex u = add_vertex(this->g);
-				pos->second = u;
-				this->NodeMap.insert(std::make_pair(u, &package));
+	size_t count = NameSpace::packageCount();
+	this->nodes.resize(count);
+	this->depends_start.assign(count + 1, 0);
+	this->dependents_start.assign(count + 1, 0);
+	for(Vertex v = 0; v < count; v++) {
+		this->nodes[v] = NameSpace::packageById(v);
+		this->depends_start[v + 1] =
+		    this->depends_start[v] + this->nodes[v]->getDepends().size();
+	}
+
+	size_t edge_count = this->depends_start[count];
+	this->depends_to.resize(edge_count);
+	this->depends_locally.resize(edge_count);
+	for(Vertex v = 0; v < count; v++) {
+		size_t e = this->depends_start[v];
+		for(auto &depend : this->nodes[v]->getDepends()) {
+			this->depends_to[e] = depend.getPackage()->getId();
+			this->depends_locally[e] = depend.getLocally();
+			this->dependents_start[this->depends_to[e] + 1]++;
+			e++;
+		}
+	}
+
+	// Reverse the edges, placing each at the next free slot for its target
+	for(Vertex v = 0; v < count; v++) {
+		this->dependents_start[v + 1] += this->dependents_start[v];
+	}
+	std::vector<size_t> next(this->dependents_start.begin(),
+	                         this->dependents_start.end() - 1);
+	this->dependents_from.resize(edge_count);
+	this->dependents_locally.resize(edge_count);
+	for(Vertex v = 0; v < count; v++) {
+		for(size_t e = this->depends_start[v]; e < this->depends_start[v + 1]; e++) {
+			size_t r = next[this->depends_to[e]]++;
+			this->dependents_from[r] = v;
+			this->dependents_locally[r] = this->depends_locally[e];
+		}
+	}
+}
+
+/**
+ * Order the vertices so that dependencies come before the packages depending on them.
+ * The order is kept up to date as dependencies are added, so there is nothing to sort.
+ *
+ * @returns The vertices in order.
+ */
+std::vector<Vertex> Internal_Graph::topologicalOrder() const
+{
+	return NameSpace::dependencyOrder();
+}
+
+/**
+ * Compute the transitive closures of every package, in one pass from the bottom of
+ * the graph up. The staging closure is the set of packages extracted into the staging
+ * directory, the depended closure is the set of packages whose install output is
+ * extracted. Both stop descending at packages that intercept them.
+ */
+void Internal_Graph::computeClosures()
+{
+	size_t count = this->nodes.size();
+	std::vector<IdSet> staging(count);
+	std::vector<IdSet> depended(count);
+
+	for(auto v : this->topologicalOrder()) {
+		for(size_t e = this->depends_start[v]; e < this->depends_start[v + 1]; e++) {
+			Vertex d = this->depends_to[e];
+			staging[v].insert(d);
+			if(!this->nodes[d]->getInterceptStaging()) {
+				staging[v].unite(staging[d]);
 			}
-		});
-	});
-
-	NameSpace::for_each([this](const NameSpace &ns) {
-		ns.for_each_package([this](Package &package) {
-			for(auto &depend : package.getDepends()) {
-				Edge e;
-				bool inserted;
-				boost::tie(e, inserted) = add_edge(
-				    this->Nodes[(&package)], this->Nodes[depend.getPackage()], this->g);
+			depended[v].insert(d);
+			if(!this->nodes[d]->getInterceptInstall()) {
+				depended[v].unite(depended[d]);
+			}
+		}
+	}
+
+	for(Vertex v = 0; v < count; v++) {
+		this->nodes[v]->setClosures(std::move(staging[v]), std::move(depended[v]));
+	}
+}
+
+/**
+ * Run a function on every package, each one only after it has been run on all of the
+ * package's dependencies. Packages that don't depend on each other are run in parallel.
+ *
+ * @param pool - The thread pool to run on.
+ * @param func - The function to run, which must not throw.
+ */
+void Internal_Graph::forEachInOrder(ThreadPool *pool,
+                                    const std::function<void(Package *)> &func) const
+{
+	size_t count = this->nodes.size();
+	std::vector<std::atomic<size_t>> remaining(count);
+	for(Vertex v = 0; v < count; v++) {
+		remaining[v] = this->depends_start[v + 1] - this->depends_start[v];
+	}
+
+	TaskGroup group(pool);
+	std::function<void(Vertex)> visit;
+	visit = [this, &func, &remaining, &group, &visit](Vertex v) {
+		func(this->nodes[v]);
+		for(size_t e = this->dependents_start[v]; e < this->dependents_start[v + 1]; e++) {
+			Vertex d = this->dependents_from[e];
+			if(--remaining[d] == 0) {
+				group.run([&visit, d] { visit(d); });
 			}
-		});
-	});
+		}
+	};
+	for(Vertex v = 0; v < count; v++) {
+		if(this->depends_start[v + 1] == this->depends_start[v]) {
+			group.run([&visit, v] { visit(v); });
+		}
+	}
+	group.wait();
 }
 
-std::unordered_set<Package *> Internal_Graph::get_cycled_packages() const
+/**
+ * Find everything that would need rebuilding if the given packages changed, that is
+ * the packages themselves and everything that depends on them, directly or not.
+ *
+ * @param packages - The changed packages.
+ *
+ * @returns The ids of the affected packages.
+ */
+IdSet Internal_Graph::dependentClosure(const std::vector<Package *> &packages) const
 {
-	struct cycle_detector : public dfs_visitor<> {
-		cycle_detector(const VertexNodeMap &_map,
-		               std::unordered_set<Package *> *_cycled_packages)
-		    : map(_map), packages(_cycled_packages)
+	IdSet closure;
+	std::vector<Vertex> stack;
+	for(auto p : packages) {
+		if(!closure.contains(p->getId())) {
+			closure.insert(p->getId());
+			stack.push_back(p->getId());
+		}
+	}
+	while(!stack.empty()) {
+		Vertex v = stack.back();
+		stack.pop_back();
+		for(size_t e = this->dependents_start[v]; e < this->dependents_start[v + 1]; e++) {
+			Vertex d = this->dependents_from[e];
+			if(!closure.contains(d)) {
+				closure.insert(d);
+				stack.push_back(d);
+			}
+		}
+	}
+	return closure;
+}
 
-		{
+/**
+ * Write the graph out in graphviz format.
+ */
+void Internal_Graph::output() const
+{
+	std::ofstream dotFile("dependencies.dot");
+	dotFile << "digraph G {" << std::endl;
+	for(Vertex v = 0; v < this->nodes.size(); v++) {
+		dotFile << v;
+		this->nodes[v]->printLabel(dotFile);
+		dotFile << ";" << std::endl;
+	}
+	for(Vertex v = 0; v < this->nodes.size(); v++) {
+		for(size_t e = this->depends_start[v]; e < this->depends_start[v + 1]; e++) {
+			dotFile << v << "->" << this->depends_to[e] << " ;" << std::endl;
 		}
+	}
+	dotFile << "}" << std::endl;
+	dotFile.flush();
+}
+
+/**
+ * Prepare the graph for scheduling builds. Counts the dependencies of each package and
+ * queues every package that has none, so that completing a package only needs to visit
+ * the packages that depend on it.
+ *
+ * Ready packages are ordered by the longest path from them to the top of the graph,
+ * weighted by the time each package took to build last time. A package with no recorded
+ * build time is assumed to take the average of the recorded times.
+ */
+void Internal_Graph::prepareSchedule()
+{
+	size_t count = this->nodes.size();
+
+	this->pending.assign(count, 0);
+	this->released.assign(count, false);
+	this->finished.assign(count, false);
+	this->finished_count = 0;
+	this->priority.assign(count, 0);
+	this->ready = {};
+	this->local_requested.assign(count, false);
+	this->local_done.assign(count, false);
+	this->local_pending.assign(count, 0);
+	this->resume_pending.assign(count, 0);
+	this->local_waiters.assign(count, std::vector<std::pair<Vertex, bool>>());
+	this->local_ready = {};
 
-		/**
-		 * Called if the DFS traverses a back edge (i.e. a cycle is found)
-		 */
-		void back_edge(Edge e, const Graph &g)
-		{
-			Vertex vertex1 = source(e, g);
-			Vertex vertex2 = target(e, g);
+	for(Vertex v = 0; v < count; v++) {
+		this->pending[v] = this->depends_start[v + 1] - this->depends_start[v];
+	}
+
+	// Packages extracting install output also wait for those packages to be fully built
+	std::vector<std::pair<Vertex, Vertex>> installs;
+	this->install_start.assign(count + 1, 0);
+	for(Vertex v = 0; v < count; v++) {
+		std::unordered_set<Package *> packages;
+		this->nodes[v]->getInstallPackages(&packages);
+		for(auto p : packages) {
+			this->pending[v]++;
+			installs.emplace_back(p->getId(), v);
+			this->install_start[p->getId() + 1]++;
+		}
+	}
+	for(Vertex v = 0; v < count; v++) {
+		this->install_start[v + 1] += this->install_start[v];
+	}
+	std::vector<size_t> next(this->install_start.begin(), this->install_start.end() - 1);
+	this->install_from.resize(installs.size());
+	for(auto &install : installs) {
+		this->install_from[next[install.first]++] = install.second;
+	}
 
-			packages->insert(this->map.at(vertex1));
-			packages->insert(this->map.at(vertex2));
+	// Get the recorded build times, -1 marks a package without one
+	std::vector<time_t> weight(count, -1);
+	time_t total = 0;
+	time_t known = 0;
+	for(Vertex v = 0; v < count; v++) {
+		time_t secs = 0;
+		if(this->nodes[v]->getPreviousBuildTime(&secs)) {
+			weight[v] = std::max<time_t>(secs, 1);
+			total += weight[v];
+			known++;
 		}
+	}
+	time_t fallback = (known != 0) ? (total / known) : 1;
 
-		const VertexNodeMap &map;
-		std::unordered_set<Package *> *packages;
-	};
+	std::vector<Vertex> order = this->topologicalOrder();
+
+	// Work down from the top of the graph accumulating the longest path
+	for(auto it = order.rbegin(); it != order.rend(); ++it) {
+		Vertex v = *it;
+		time_t longest = 0;
+		for(size_t e = this->dependents_start[v]; e < this->dependents_start[v + 1]; e++) {
+			longest = std::max(longest, this->priority[this->dependents_from[e]]);
+		}
+		this->priority[v] = longest + ((weight[v] < 0) ? fallback : weight[v]);
+	}
 
-	std::unordered_set<Package *> cycled_packages;
+	for(Vertex v = 0; v < count; v++) {
+		if(this->pending[v] == 0) {
+			this->ready.emplace(this->priority[v], v);
+		}
+	}
 
-	cycle_detector vis(this->NodeMap, &cycled_packages);
-	depth_first_search(this->g, visitor(vis));
+	this->by_priority.resize(count);
+	std::iota(this->by_priority.begin(), this->by_priority.end(), 0);
+	std::stable_sort(this->by_priority.begin(), this->by_priority.end(),
+	                 [this](Vertex a, Vertex b) { return this->priority[a] > this->priority[b]; });
+	this->longest_unbuilt = 0;
+}
+
+/**
+ * Take the next package that is ready to be built. The package with the longest
+ * remaining path to the top of the graph is returned first.
+ *
+ * @returns The package, or nullptr if no package is currently ready.
+ */
+Package *Internal_Graph::topoNext()
+{
+	if(this->ready.empty()) {
+		return nullptr;
+	}
 
-	return cycled_packages;
+	Vertex v = this->ready.top().second;
+	this->ready.pop();
+	return this->nodes[v];
 }
 
-void Internal_Graph::output() const
+/**
+ * Take the next package that is ready to be built and fits. Packages are considered in
+ * the same order as topoNext(), so a package that doesn't fit is passed over for the
+ * next one that does.
+ *
+ * @param fits - Test whether a package fits.
+ *
+ * @returns The package, or nullptr if no ready package fits.
+ */
+Package *Internal_Graph::topoNext(const std::function<bool(Package *)> &fits)
 {
-	std::ofstream dotFile("dependencies.dot");
-	write_graphviz(dotFile, this->g, VertexNodeMap_property_writer(this->NodeMap));
-	dotFile.flush();
+	std::vector<std::pair<time_t, Vertex>> skipped;
+	Package *next = nullptr;
+	while(!this->ready.empty()) {
+		auto top = this->ready.top();
+		this->ready.pop();
+		if(fits(this->nodes[top.second])) {
+			next = this->nodes[top.second];
+			break;
+		}
+		skipped.push_back(top);
+	}
+
+	for(auto &s : skipped) {
+		this->ready.push(s);
+	}
+	return next;
+}
+
+/**
+ * One fewer dependency of a vertex is unbuilt, add it to the ready queue if that was
+ * the last one.
+ *
+ * @param v - The vertex.
+ */
+void Internal_Graph::releaseDependent(Vertex v)
+{
+	if(--this->pending[v] == 0) {
+		this->ready.emplace(this->priority[v], v);
+	}
+}
+
+/**
+ * Mark the staging output of a package as final. Any package whose last unreleased
+ * dependency was this package, and that doesn't extract its install output, is added
+ * to the ready queue.
+ *
+ * @param p - The package that has released its staging output.
+ */
+void Internal_Graph::packageStagingReleased(Package *p)
+{
+	Vertex v = p->getId();
+	if(this->released[v]) {
+		return;
+	}
+	this->released[v] = true;
+
+	for(size_t e = this->dependents_start[v]; e < this->dependents_start[v + 1]; e++) {
+		// Rebuilding a package locally can't start until it is fully built
+		if(!this->dependents_locally[e]) {
+			this->releaseDependent(this->dependents_from[e]);
+		}
+	}
+}
+
+/**
+ * Mark a package as built. This releases the staging output (if not already done),
+ * and any package that was waiting for the install output of this package.
+ *
+ * @param p - The package that has been built.
+ */
+void Internal_Graph::packageBuilt(Package *p)
+{
+	this->packageStagingReleased(p);
+
+	Vertex v = p->getId();
+	if(this->finished[v]) {
+		return;
+	}
+	this->finished[v] = true;
+	this->finished_count++;
+	while(this->longest_unbuilt < this->by_priority.size() &&
+	      this->finished[this->by_priority[this->longest_unbuilt]]) {
+		this->longest_unbuilt++;
+	}
+
+	for(size_t e = this->dependents_start[v]; e < this->dependents_start[v + 1]; e++) {
+		if(this->dependents_locally[e]) {
+			this->releaseDependent(this->dependents_from[e]);
+		}
+	}
+	for(size_t i = this->install_start[v]; i < this->install_start[v + 1]; i++) {
+		this->releaseDependent(this->install_from[i]);
+	}
+}
+
+/**
+ * Estimate how long the rest of the build will take. This is the longest remaining path
+ * from a package that hasn't been built, so it assumes enough packages can build at once.
+ * packageBuilt() keeps track of the longest such path, so this doesn't scan the graph.
+ *
+ * @returns The estimate, in seconds.
+ */
+time_t Internal_Graph::remainingTime() const
+{
+	if(this->longest_unbuilt >= this->by_priority.size()) {
+		return 0;
+	}
+	return this->priority[this->by_priority[this->longest_unbuilt]];
+}
+
+/**
+ * Queue a package to be rebuilt locally, along with any packages it needs rebuilt
+ * locally first.
+ *
+ * @param l - The vertex of the package to rebuild locally.
+ */
+void Internal_Graph::requestLocalBuild(Vertex l)
+{
+	if(this->local_requested[l]) {
+		return;
+	}
+	this->local_requested[l] = true;
+
+	for(size_t e = this->depends_start[l]; e < this->depends_start[l + 1]; e++) {
+		Vertex m = this->depends_to[e];
+		if(!this->depends_locally[e] || this->local_done[m] || this->nodes[m]->wasBuilt()) {
+			continue;
+		}
+		this->local_pending[l]++;
+		this->local_waiters[m].emplace_back(l, true);
+		this->requestLocalBuild(m);
+	}
+
+	if(this->local_pending[l] == 0) {
+		this->local_ready.push(l);
+	}
 }
 
-void Internal_Graph::topological()
+/**
+ * A package needs its locally depended packages rebuilt before it can continue
+ * building. Queue the rebuilds, the package is ready again once they are done.
+ *
+ * @param p - The package waiting for the rebuilds.
+ */
+void Internal_Graph::packageNeedsLocalBuilds(Package *p)
 {
-	this->c.clear();
+	Vertex v = p->getId();
+	for(size_t e = this->depends_start[v]; e < this->depends_start[v + 1]; e++) {
+		Vertex l = this->depends_to[e];
+		if(!this->depends_locally[e] || this->local_done[l] || this->nodes[l]->wasBuilt()) {
+			continue;
+		}
+		this->resume_pending[v]++;
+		this->local_waiters[l].emplace_back(v, false);
+		this->requestLocalBuild(l);
+	}
 
-	topological_sort(this->g, std::back_inserter(this->c));
+	if(this->resume_pending[v] == 0) {
+		this->ready.emplace(this->priority[v], v);
+	}
 }
 
-void Internal_Graph::deleteNode(Package *p)
+/**
+ * Take the next package that is ready to be rebuilt locally.
+ *
+ * @returns The package, or nullptr if no local rebuild is currently ready.
+ */
+Package *Internal_Graph::localNext()
 {
-	clear_vertex(this->Nodes[p], this->g);
+	if(this->local_ready.empty()) {
+		return nullptr;
+	}
+
+	Vertex v = this->local_ready.front();
+	this->local_ready.pop();
+	return this->nodes[v];
 }
 
-Package *Internal_Graph::topoNext()
+/**
+ * Mark a package as rebuilt locally. Local rebuilds and packages waiting on only this
+ * rebuild are made ready.
+ *
+ * @param p - The package that has been rebuilt.
+ */
+void Internal_Graph::packageLocallyBuilt(Package *p)
 {
-	Package *n = nullptr;
+	Vertex l = p->getId();
+	this->local_done[l] = true;
 
-	for(auto &ii : c) {
-		Package *p = this->NodeMap[ii];
-		if(!(p->isBuilt()) && !(p->isBuilding()) && p->canBuild()) {
-			n = p;
+	for(auto &waiter : this->local_waiters[l]) {
+		if(waiter.second) {
+			if(--this->local_pending[waiter.first] == 0) {
+				this->local_ready.push(waiter.first);
+			}
+		} else if(--this->resume_pending[waiter.first] == 0) {
+			this->ready.emplace(this->priority[waiter.first], waiter.first);
 		}
 	}
-	return n;
+	this->local_waiters[l].clear();
 }
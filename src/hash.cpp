@@ -24,12 +24,109 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 *******************************************************************************/
 
 #include "hash.hpp"
+#include "hashcache.hpp"
 #include "logger.hpp"
-#include <iomanip>
+#include "threadpool.hpp"
+#include <algorithm>
+#include <cerrno>
+#include <cstdlib>
+#include <fcntl.h>
+#include <filesystem>
+#include <locale.h>
+#include <memory>
+#include <numeric>
 #include <openssl/evp.h>
-#include <sstream>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
 #include <vector>
 
+//! How much of a file is read at once
+static const size_t read_size = 1024 * 1024;
+
+/**
+ * Encode a digest in hex.
+ *
+ * @param data - The digest.
+ * @param length - The length of the digest.
+ *
+ * @returns The digest in hex.
+ */
+static std::string to_hex(const unsigned char *data, size_t length)
+{
+	static const char digits[] = "0123456789abcdef";
+	std::string hex(length * 2, '0');
+	for(size_t i = 0; i < length; i++) {
+		hex[2 * i] = digits[data[i] >> 4];
+		hex[2 * i + 1] = digits[data[i] & 0xf];
+	}
+	return hex;
+}
+
+/**
+ * Finish a digest.
+ *
+ * @param ctx - The digest context.
+ *
+ * @returns The digest in hex.
+ */
+static std::string finish_digest(EVP_MD_CTX *ctx)
+{
+	unsigned char md_value[EVP_MAX_MD_SIZE];
+	unsigned int md_len = 0;
+	EVP_DigestFinal_ex(ctx, md_value, &md_len);
+	return to_hex(md_value, md_len);
+}
+
+/**
+ * Construct a Hasher, ready for data.
+ */
+buildsys::Hasher::Hasher() : ctx(EVP_MD_CTX_create())
+{
+	EVP_DigestInit_ex(this->ctx, EVP_sha256(), nullptr);
+}
+
+/**
+ * Destroy the Hasher.
+ */
+buildsys::Hasher::~Hasher()
+{
+	EVP_MD_CTX_destroy(this->ctx);
+}
+
+/**
+ * Add data to the digest.
+ *
+ * @param data - The data.
+ * @param length - The length of the data.
+ */
+void buildsys::Hasher::update(const char *data, size_t length)
+{
+	EVP_DigestUpdate(this->ctx, data, length);
+}
+
+/**
+ * Finish the digest. No more data can be added afterwards.
+ *
+ * @returns The digest, in hex (as hash_file gives).
+ */
+std::string buildsys::Hasher::finish()
+{
+	return finish_digest(this->ctx);
+}
+
+static buildsys::HashCache *hash_cache = nullptr;
+static buildsys::HashAlgorithm change_algorithm = buildsys::HashAlgorithm::SHA256;
+
+//! The name and digest of each algorithm, in the order of HashAlgorithm
+static const struct {
+	const char *name;
+	const EVP_MD *(*md)();
+} algorithms[] = {
+    {"sha256", EVP_sha256},
+    {"blake2b512", EVP_blake2b512},
+};
+
 void buildsys::hash_setup()
 {
 	OpenSSL_add_all_digests();
@@ -40,38 +137,355 @@ void buildsys::hash_shutdown()
 	EVP_cleanup();
 }
 
-std::string buildsys::hash_file(const std::string &fname)
+/**
+ * Set where to keep the digests of files, so that they aren't hashed again while they
+ * are unchanged.
+ *
+ * @param cache - The digests of files, or nullptr to always hash them.
+ */
+void buildsys::hash_set_cache(HashCache *cache)
 {
-	EVP_MD_CTX *mdctx;
-	const EVP_MD *md;
-	std::vector<char> buff(4096);
-	std::vector<unsigned char> md_value(EVP_MAX_MD_SIZE);
-	unsigned int md_len;
+	hash_cache = cache;
+}
 
-	md = EVP_get_digestbyname("sha256");
+/**
+ * Find an algorithm by name.
+ *
+ * @param name - The name of the algorithm (e.g. "sha256").
+ * @param algorithm - Set to the algorithm.
+ *
+ * @returns true if the algorithm was found, false otherwise.
+ */
+bool buildsys::hash_algorithm_from_name(const std::string &name, HashAlgorithm *algorithm)
+{
+	for(size_t i = 0; i < sizeof(algorithms) / sizeof(algorithms[0]); i++) {
+		if(name == algorithms[i].name) {
+			*algorithm = static_cast<HashAlgorithm>(i);
+			return true;
+		}
+	}
+	return false;
+}
 
-	mdctx = EVP_MD_CTX_create();
-	EVP_DigestInit_ex(mdctx, md, nullptr);
+/**
+ * Get the name of an algorithm.
+ *
+ * @param algorithm - The algorithm.
+ *
+ * @returns The name.
+ */
+std::string buildsys::hash_algorithm_name(HashAlgorithm algorithm)
+{
+	return algorithms[static_cast<size_t>(algorithm)].name;
+}
 
-	std::ifstream input(fname, std::ios::in | std::ifstream::binary);
-	if(!input.is_open()) {
-		Logger("BuildSys").log("Failed opening: " + fname);
+/**
+ * Set the algorithm used to work out whether files have changed, by hash_file() and
+ * hash_tree().
+ *
+ * @param algorithm - The algorithm.
+ */
+void buildsys::hash_set_algorithm(HashAlgorithm algorithm)
+{
+	change_algorithm = algorithm;
+}
+
+/**
+ * Get the algorithm used to work out whether files have changed.
+ *
+ * @returns The algorithm.
+ */
+buildsys::HashAlgorithm buildsys::hash_get_algorithm()
+{
+	return change_algorithm;
+}
+
+/**
+ * The digest context and read buffer of a thread, kept for every file the thread
+ * hashes rather than being set up each time.
+ */
+struct FileHashState {
+	EVP_MD_CTX *ctx{EVP_MD_CTX_create()};
+	//! Page aligned, so the kernel can copy into it quickly
+	std::unique_ptr<char, decltype(&std::free)> buffer{
+	    static_cast<char *>(aligned_alloc(4096, read_size)), &std::free};
+
+	FileHashState() = default;
+	~FileHashState()
+	{
+		EVP_MD_CTX_destroy(this->ctx);
+	}
+	FileHashState(const FileHashState &) = delete;
+	FileHashState &operator=(const FileHashState &) = delete;
+	FileHashState(FileHashState &&) = delete;
+	FileHashState &operator=(FileHashState &&) = delete;
+};
+
+/**
+ * Read and hash the contents of a file. Files are read in large pieces, and the
+ * kernel is told they are read sequentially so that it reads ahead. They are not
+ * mapped into memory, as a file truncated while it was mapped would crash us.
+ *
+ * @param fname - The file.
+ * @param algorithm - The algorithm to hash with.
+ *
+ * @returns The digest in hex, or an empty string if the file can't be read.
+ */
+static std::string hash_contents(const std::string &fname,
+                                 buildsys::HashAlgorithm algorithm)
+{
+	int fd = open(fname.c_str(), O_RDONLY | O_CLOEXEC);
+	if(fd < 0) {
+		buildsys::Logger("BuildSys").log("Failed opening: " + fname);
 		return std::string("");
 	}
-	while(!input.eof()) {
-		input.read(&buff[0], static_cast<std::streamsize>(buff.size()));
-		EVP_DigestUpdate(mdctx, &buff[0], static_cast<size_t>(input.gcount()));
+	posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+
+	thread_local FileHashState state;
+	EVP_DigestInit_ex(state.ctx, algorithms[static_cast<size_t>(algorithm)].md(), nullptr);
+	ssize_t res = 0;
+	do {
+		res = read(fd, state.buffer.get(), read_size);
+		if(res > 0) {
+			EVP_DigestUpdate(state.ctx, state.buffer.get(), static_cast<size_t>(res));
+		}
+	} while(res > 0 || (res < 0 && errno == EINTR));
+	close(fd);
+
+	std::string digest = finish_digest(state.ctx);
+	if(res < 0) {
+		buildsys::Logger("BuildSys").log("Failed reading: " + fname);
+		return std::string("");
+	}
+	return digest;
+}
+
+/**
+ * Get the digest of a file, by the algorithm used to work out whether files have
+ * changed, without reading it if the digest is known.
+ *
+ * @param fname - The file.
+ *
+ * @returns The digest in hex, or an empty string if the file can't be read.
+ */
+std::string buildsys::hash_file(const std::string &fname)
+{
+	return hash_file(fname, change_algorithm);
+}
+
+/**
+ * Get the digest of a file, without reading it if the digest is known.
+ *
+ * @param fname - The file.
+ * @param algorithm - The algorithm to hash with.
+ *
+ * @returns The digest in hex, or an empty string if the file can't be read.
+ */
+std::string buildsys::hash_file(const std::string &fname, HashAlgorithm algorithm)
+{
+	struct stat st = {};
+	bool cacheable =
+	    hash_cache != nullptr && stat(fname.c_str(), &st) == 0 && S_ISREG(st.st_mode);
+	std::string name = hash_algorithm_name(algorithm);
+	std::string digest;
+	if(cacheable && hash_cache->find(st, name, &digest)) {
+		return digest;
+	}
+	digest = hash_contents(fname, algorithm);
+	if(cacheable && !digest.empty()) {
+		hash_cache->record(fname, st, name, digest);
+	}
+	return digest;
+}
+
+/**
+ * Escape a file name as sha256sum does, for names with a backslash, newline or
+ * carriage return in them (the line is then also started with a backslash).
+ *
+ * @param name - The file name.
+ *
+ * @returns The escaped name, or the name if it needs no escaping.
+ */
+static std::string escape_name(const std::string &name)
+{
+	std::string escaped;
+	for(char c : name) {
+		if(c == '\\') {
+			escaped += "\\\\";
+		} else if(c == '\n') {
+			escaped += "\\n";
+		} else if(c == '\r') {
+			escaped += "\\r";
+		} else {
+			escaped += c;
+		}
+	}
+	return escaped;
+}
+
+/**
+ * Hash every file under a directory, spreading the files over a thread pool. The
+ * output is what "find -type f -exec sha256sum {} \; | sort -k 2" gives when run in
+ * the directory, sorted in the collation order of the environment as sort does (but
+ * with the digests of the algorithm used to work out whether files have changed).
+ *
+ * @param dir - The directory.
+ * @param pool - The thread pool to hash on, or nullptr to hash on this thread.
+ * @param out - Where to write the digests.
+ *
+ * @returns true if every file was hashed, false otherwise.
+ */
+bool buildsys::hash_tree(const std::string &dir, ThreadPool *pool, std::ostream &out)
+{
+	namespace filesystem = std::filesystem;
+	// Regular files only, symbolic links aren't followed
+	std::vector<std::string> names;
+	std::error_code ec;
+	auto options = filesystem::directory_options::skip_permission_denied;
+	filesystem::recursive_directory_iterator it(dir, options, ec);
+	for(; !ec && it != filesystem::recursive_directory_iterator(); it.increment(ec)) {
+		if(filesystem::is_regular_file(it->symlink_status())) {
+			names.push_back(it->path().lexically_relative(dir).string());
+		}
+	}
+	if(ec) {
+		buildsys::Logger("BuildSys").log("Failed listing: " + dir);
+		return false;
 	}
 
-	EVP_DigestFinal_ex(mdctx, &md_value[0], &md_len);
-	EVP_MD_CTX_destroy(mdctx);
+	std::vector<std::string> digests(names.size());
+	const size_t batch = 32;
+	TaskGroup group(pool);
+	for(size_t start = 0; start < names.size(); start += batch) {
+		group.run([&dir, &names, &digests, start, batch] {
+			size_t end = std::min(start + batch, names.size());
+			for(size_t i = start; i < end; i++) {
+				digests[i] = hash_contents(dir + "/" + names[i], change_algorithm);
+			}
+		});
+	}
+	group.wait();
 
-	std::stringstream ss;
+	// <digest>  ./<name>, sorted on the name as sort -k 2 would
+	std::vector<std::string> keys(names.size());
+	std::vector<std::string> lines(names.size());
+	for(size_t i = 0; i < names.size(); i++) {
+		std::string escaped = escape_name(names[i]);
+		keys[i] = "  ./" + escaped;
+		lines[i] = ((escaped != names[i]) ? "\\" : "") + digests[i] + keys[i];
+	}
+	locale_t collation = newlocale(LC_COLLATE_MASK, "", nullptr);
+	if(collation == nullptr) {
+		collation = newlocale(LC_COLLATE_MASK, "C", nullptr);
+	}
+	std::vector<size_t> order(names.size());
+	std::iota(order.begin(), order.end(), 0);
+	std::sort(order.begin(), order.end(), [&keys, &lines, collation](size_t a, size_t b) {
+		int res = strcoll_l(keys[a].c_str(), keys[b].c_str(), collation);
+		if(res == 0) {
+			res = strcoll_l(lines[a].c_str(), lines[b].c_str(), collation);
+		}
+		if(res == 0) {
+			res = lines[a].compare(lines[b]);
+		}
+		return res < 0;
+	});
+	freelocale(collation);
 
-	for(unsigned int i = 0; i < md_len; i++) {
-		ss << std::hex << std::setfill('0') << std::setw(2)
-		   << static_cast<int>(md_value[i]);
+	bool hashed = true;
+	for(size_t i : order) {
+		// Files that can't be read are left out, as sha256sum does
+		if(digests[i].empty()) {
+			hashed = false;
+			continue;
+		}
+		out << lines[i] << '\n';
 	}
+	return hashed && out.good();
+}
 
-	return ss.str();
+/**
+ * Work out a Merkle hash of a file or directory. Files are hashed with hash_file(), so
+ * only files that have changed since they were last hashed are read again. Each
+ * directory is hashed over the type, digest and name of the entries in it, so the hash
+ * changes when any file under it changes, or is added, removed, renamed or made
+ * executable. Symbolic links under the directory are hashed over their target, and
+ * are not followed.
+ *
+ * @param path - The file or directory.
+ * @param follow - Whether path is followed when it is a symbolic link.
+ *
+ * @returns The digest, or an empty string if something under path can't be read.
+ */
+static std::string merkle_digest(const std::string &path, bool follow)
+{
+	struct stat st = {};
+	if((follow ? stat(path.c_str(), &st) : lstat(path.c_str(), &st)) != 0) {
+		return "";
+	}
+	if(S_ISREG(st.st_mode)) {
+		return buildsys::hash_file(path);
+	}
+	buildsys::Hasher hasher;
+	if(S_ISLNK(st.st_mode)) {
+		std::error_code ec;
+		std::string target = std::filesystem::read_symlink(path, ec).string();
+		if(ec) {
+			return "";
+		}
+		hasher.update(target.data(), target.size());
+		return hasher.finish();
+	}
+	if(!S_ISDIR(st.st_mode)) {
+		return "";
+	}
+
+	std::vector<std::string> names;
+	std::error_code ec;
+	for(std::filesystem::directory_iterator it(path, ec), end; !ec && it != end;
+	    it.increment(ec)) {
+		names.push_back(it->path().filename().string());
+	}
+	if(ec) {
+		return "";
+	}
+	std::sort(names.begin(), names.end());
+
+	// <type> <digest> <name>\0 for each entry, sockets and the like are left out
+	for(const auto &name : names) {
+		std::string child = path + "/" + name;
+		if(lstat(child.c_str(), &st) != 0) {
+			return "";
+		}
+		char type = 0;
+		if(S_ISREG(st.st_mode)) {
+			type = (st.st_mode & S_IXUSR) ? 'x' : 'f';
+		} else if(S_ISDIR(st.st_mode)) {
+			type = 'd';
+		} else if(S_ISLNK(st.st_mode)) {
+			type = 'l';
+		} else {
+			continue;
+		}
+		std::string digest = merkle_digest(child, false);
+		if(digest.empty()) {
+			return "";
+		}
+		std::string entry = std::string(1, type) + " " + digest + " " + name;
+		hasher.update(entry.c_str(), entry.size() + 1);
+	}
+	return hasher.finish();
+}
+
+/**
+ * Work out a Merkle hash of a file or directory, following path if it is a symbolic
+ * link.
+ *
+ * @param path - The file or directory.
+ *
+ * @returns The digest, or an empty string if something under path can't be read.
+ */
+std::string buildsys::hash_merkle(const std::string &path)
+{
+	return merkle_digest(path, true);
 }
@@ -26,12 +26,52 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #ifndef HASH_HPP_
 #define HASH_HPP_
 
+#include <ostream>
 #include <string>
 
+struct evp_md_ctx_st;
+
 namespace buildsys
 {
+	/**
+	 * A SHA256 digest worked out a piece at a time, e.g. as data is received.
+	 */
+	class Hasher
+	{
+	private:
+		evp_md_ctx_st *ctx{nullptr};
+
+	public:
+		Hasher();
+		~Hasher();
+		Hasher(const Hasher &) = delete;
+		Hasher &operator=(const Hasher &) = delete;
+		Hasher(Hasher &&) = delete;
+		Hasher &operator=(Hasher &&) = delete;
+		void update(const char *data, size_t length);
+		std::string finish();
+	};
+
+	/**
+	 * The algorithms files can be hashed with. Downloads are always checked with
+	 * SHA256, as that is what Digest files hold. Whether files have changed is
+	 * worked out with the algorithm chosen by hash_set_algorithm().
+	 */
+	enum class HashAlgorithm { SHA256, BLAKE2b512 };
+
+	class HashCache;
+	class ThreadPool;
+
 	void hash_setup();
+	void hash_set_cache(HashCache *cache);
+	bool hash_algorithm_from_name(const std::string &name, HashAlgorithm *algorithm);
+	std::string hash_algorithm_name(HashAlgorithm algorithm);
+	void hash_set_algorithm(HashAlgorithm algorithm);
+	HashAlgorithm hash_get_algorithm();
 	std::string hash_file(const std::string &fname);
+	std::string hash_file(const std::string &fname, HashAlgorithm algorithm);
+	bool hash_tree(const std::string &dir, ThreadPool *pool, std::ostream &out);
+	std::string hash_merkle(const std::string &path);
 	void hash_shutdown();
 } // namespace buildsys
 
@@ -0,0 +1,216 @@
+/******************************************************************************
+ Copyright 2026 Allied Telesis Labs Ltd. All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+    1. Redistributions of source code must retain the above copyright notice,
+       this list of conditions and the following disclaimer.
+
+    2. Redistributions in binary form must reproduce the above copyright
+       notice, this list of conditions and the following disclaimer in the
+       documentation and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*******************************************************************************/
+
+#include "hashcache.hpp"
+#include <cstdio>
+#include <ctime>
+#include <sstream>
+
+using namespace buildsys;
+
+//! A time from a stat result, in nanoseconds
+static int64_t time_ns(const struct timespec &ts)
+{
+	return static_cast<int64_t>(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+}
+
+//! The device and inode of a file, and the algorithm, which the entries are kept by
+static std::tuple<uint64_t, uint64_t, std::string> file_key(const struct stat &st,
+                                                            const std::string &algorithm)
+{
+	return {st.st_dev, st.st_ino, algorithm};
+}
+
+/**
+ * Write an entry as a line of the cache file.
+ *
+ * @param out - The stream to write to.
+ * @param dev - The device of the file.
+ * @param ino - The inode of the file.
+ * @param algorithm - The algorithm of the digest.
+ * @param size - The size of the file.
+ * @param mtime_ns - The modification time of the file.
+ * @param ctime_ns - The change time of the file.
+ * @param digest - The digest of the file.
+ * @param file - The path to the file.
+ */
+static void write_entry(std::ostream &out, uint64_t dev, uint64_t ino,
+                        const std::string &algorithm, uint64_t size, int64_t mtime_ns,
+                        int64_t ctime_ns, const std::string &digest,
+                        const std::string &file)
+{
+	out << dev << ' ' << ino << ' ' << algorithm << ' ' << size << ' ' << mtime_ns << ' '
+	    << ctime_ns << ' ' << digest << ' ' << file << '\n';
+}
+
+/**
+ * Construct the HashCache. Nothing is read until load() is called.
+ *
+ * @param _path - The file to keep the digests in.
+ * @param _settle_secs - How long ago a file must have changed for its digest to be
+ *                       kept.
+ */
+HashCache::HashCache(std::string _path, int64_t _settle_secs)
+    : path(std::move(_path)), settle_secs(_settle_secs)
+{
+}
+
+/**
+ * Check whether an entry is for the file as it is now.
+ *
+ * @param entry - The entry.
+ * @param st - The stat result for the file.
+ *
+ * @returns true if the file is unchanged, false otherwise.
+ */
+bool HashCache::matches(const Entry &entry, const struct stat &st)
+{
+	return entry.size == static_cast<uint64_t>(st.st_size) &&
+	       entry.mtime_ns == time_ns(st.st_mtim) && entry.ctime_ns == time_ns(st.st_ctim);
+}
+
+/**
+ * Read the cache file. Lines that can't be parsed (e.g. from an interrupted write)
+ * are skipped. If the file holds many more lines than entries, it is rewritten with
+ * only the entries of files that are still unchanged.
+ */
+void HashCache::load()
+{
+	std::unique_lock<std::mutex> lk(this->lock);
+	this->entries.clear();
+	this->out.close();
+
+	std::ifstream in(this->path);
+	std::string line;
+	size_t lines = 0;
+	while(std::getline(in, line)) {
+		std::istringstream fields(line);
+		uint64_t dev = 0;
+		uint64_t ino = 0;
+		std::string algorithm;
+		Entry entry;
+		if(!(fields >> dev >> ino >> algorithm >> entry.size >> entry.mtime_ns >>
+		     entry.ctime_ns >> entry.digest) ||
+		   !std::getline(fields >> std::ws, entry.path) || entry.path.empty()) {
+			continue;
+		}
+		lines++;
+		this->entries[{dev, ino, algorithm}] = std::move(entry);
+	}
+	in.close();
+
+	if(lines > 2 * this->entries.size() + 1024) {
+		std::string tmp_path = this->path + ".tmp";
+		std::ofstream tmp(tmp_path);
+		for(auto it = this->entries.begin(); it != this->entries.end();) {
+			struct stat st = {};
+			const Entry &entry = it->second;
+			const std::string &algorithm = std::get<2>(it->first);
+			if(stat(entry.path.c_str(), &st) != 0 ||
+			   file_key(st, algorithm) != it->first || !HashCache::matches(entry, st)) {
+				it = this->entries.erase(it);
+				continue;
+			}
+			write_entry(tmp, std::get<0>(it->first), std::get<1>(it->first), algorithm,
+			            entry.size, entry.mtime_ns, entry.ctime_ns, entry.digest,
+			            entry.path);
+			++it;
+		}
+		tmp.close();
+		if(tmp.good()) {
+			std::rename(tmp_path.c_str(), this->path.c_str());
+		}
+	}
+
+	this->out.open(this->path, std::ios::app);
+}
+
+/**
+ * Find the digest of a file, if it hasn't changed since it was hashed.
+ *
+ * @param st - The stat result for the file.
+ * @param algorithm - The algorithm of the digest.
+ * @param digest - Set to the digest.
+ *
+ * @returns true if the digest was found, false otherwise.
+ */
+bool HashCache::find(const struct stat &st, const std::string &algorithm,
+                     std::string *digest)
+{
+	std::unique_lock<std::mutex> lk(this->lock);
+	auto it = this->entries.find(file_key(st, algorithm));
+	if(it == this->entries.end() || !HashCache::matches(it->second, st)) {
+		this->misses++;
+		return false;
+	}
+	*digest = it->second.digest;
+	this->hits++;
+	return true;
+}
+
+/**
+ * Record the digest of a file, appending it to the cache file. Files that have only
+ * just changed aren't recorded.
+ *
+ * @param file - The path to the file.
+ * @param st - The stat result for the file, from before it was hashed.
+ * @param algorithm - The algorithm of the digest.
+ * @param digest - The digest.
+ */
+void HashCache::record(const std::string &file, const struct stat &st,
+                       const std::string &algorithm, const std::string &digest)
+{
+	time_t now = time(nullptr);
+	if(st.st_mtim.tv_sec > now - this->settle_secs ||
+	   st.st_ctim.tv_sec > now - this->settle_secs ||
+	   file.find('\n') != std::string::npos) {
+		return;
+	}
+
+	std::unique_lock<std::mutex> lk(this->lock);
+	auto key = file_key(st, algorithm);
+	Entry &entry = this->entries[key];
+	entry.size = static_cast<uint64_t>(st.st_size);
+	entry.mtime_ns = time_ns(st.st_mtim);
+	entry.ctime_ns = time_ns(st.st_ctim);
+	entry.digest = digest;
+	entry.path = file;
+	if(this->out.is_open()) {
+		write_entry(this->out, std::get<0>(key), std::get<1>(key), algorithm, entry.size,
+		            entry.mtime_ns, entry.ctime_ns, entry.digest, entry.path);
+		this->out.flush();
+	}
+}
+
+/**
+ * Get the number of files with a digest.
+ *
+ * @returns The number of files.
+ */
+size_t HashCache::size() const
+{
+	std::unique_lock<std::mutex> lk(this->lock);
+	return this->entries.size();
+}
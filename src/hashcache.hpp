@@ -0,0 +1,91 @@
+/******************************************************************************
+ Copyright 2026 Allied Telesis Labs Ltd. All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+    1. Redistributions of source code must retain the above copyright notice,
+       this list of conditions and the following disclaimer.
+
+    2. Redistributions in binary form must reproduce the above copyright
+       notice, this list of conditions and the following disclaimer in the
+       documentation and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*******************************************************************************/
+
+#ifndef HASHCACHE_HPP_
+#define HASHCACHE_HPP_
+
+#include <atomic>
+#include <cstdint>
+#include <fstream>
+#include <map>
+#include <mutex>
+#include <string>
+#include <sys/stat.h>
+#include <tuple>
+
+namespace buildsys
+{
+	/**
+	 * The digests of files, kept across runs so that unchanged files aren't read and
+	 * hashed again. A digest is only used while the file has the same device, inode,
+	 * size, modification time and change time as when it was hashed. Digests by
+	 * different algorithms are kept apart. Each digest is
+	 * appended to a file as one line. The whole file is read at startup, and rewritten
+	 * without the digests of changed or removed files when it has grown too much.
+	 */
+	class HashCache
+	{
+	private:
+		struct Entry {
+			uint64_t size{0};
+			int64_t mtime_ns{0};
+			int64_t ctime_ns{0};
+			std::string digest;
+			std::string path;
+		};
+		std::string path;
+		//! Files changed more recently than this (in seconds) may change again without
+		//! their times changing, so their digests aren't kept
+		const int64_t settle_secs;
+		//! The entries, by device, inode and algorithm
+		using Key = std::tuple<uint64_t, uint64_t, std::string>;
+		std::map<Key, Entry> entries;
+		std::ofstream out;
+		std::atomic<size_t> hits{0};
+		std::atomic<size_t> misses{0};
+		mutable std::mutex lock;
+		static bool matches(const Entry &entry, const struct stat &st);
+
+	public:
+		explicit HashCache(std::string _path, int64_t _settle_secs = 2);
+		void load();
+		bool find(const struct stat &st, const std::string &algorithm, std::string *digest);
+		void record(const std::string &file, const struct stat &st,
+		            const std::string &algorithm, const std::string &digest);
+		size_t size() const;
+		//! How many digests were found
+		size_t getHits() const
+		{
+			return this->hits;
+		}
+		//! How many files had to be hashed
+		size_t getMisses() const
+		{
+			return this->misses;
+		}
+	};
+} // namespace buildsys
+
+#endif // HASHCACHE_HPP_
@@ -0,0 +1,183 @@
+/******************************************************************************
+ Copyright 2026 Allied Telesis Labs Ltd. All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+    1. Redistributions of source code must retain the above copyright notice,
+       this list of conditions and the following disclaimer.
+
+    2. Redistributions in binary form must reproduce the above copyright
+       notice, this list of conditions and the following disclaimer in the
+       documentation and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*******************************************************************************/
+
+#include "history.hpp"
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+#include <utility>
+
+using namespace buildsys;
+
+const size_t BuildHistory::runs_kept;
+
+/**
+ * Write a record as a line of the history file.
+ *
+ * @param out - The stream to write to.
+ * @param key - The namespace/package the record is for.
+ * @param r - The record.
+ */
+static void write_record(std::ostream &out, const std::string &key,
+                         const BuildHistory::Record &r)
+{
+	out << key << ' ' << (r.hash.empty() ? "-" : r.hash) << ' ' << r.started << ' '
+	    << r.outcome << ' ' << r.total_ms << ' ' << r.fetch_ms << ' ' << r.prepare_ms << ' '
+	    << r.commands_ms << ' ' << r.package_ms << ' ' << r.cpu_ms << ' ' << r.peak_rss_kb
+	    << ' ' << r.bytes_written << '\n';
+}
+
+/**
+ * Add a run to those kept for a package, dropping the oldest run once there are too
+ * many. The latest run that built the package is never dropped, so a package that
+ * has been current for many runs still has a build time.
+ *
+ * @param runs - The runs kept for the package, oldest first.
+ * @param r - The run to add.
+ */
+static void keep_run(std::deque<BuildHistory::Record> *runs, BuildHistory::Record r)
+{
+	runs->push_back(std::move(r));
+	if(runs->size() <= BuildHistory::runs_kept) {
+		return;
+	}
+
+	auto oldest = runs->begin();
+	if(oldest->outcome == "built" &&
+	   std::none_of(runs->begin() + 1, runs->end(),
+	                [](const BuildHistory::Record &run) { return run.outcome == "built"; })) {
+		++oldest;
+	}
+	runs->erase(oldest);
+}
+
+/**
+ * Construct the BuildHistory. Nothing is read until load() is called.
+ *
+ * @param _path - The file to keep the history in.
+ */
+BuildHistory::BuildHistory(std::string _path) : path(std::move(_path))
+{
+}
+
+/**
+ * Read the history file. Lines that can't be parsed (e.g. from an interrupted write)
+ * are skipped. If more runs were read than are kept, the file is rewritten with only
+ * the kept runs.
+ */
+void BuildHistory::load()
+{
+	std::unique_lock<std::mutex> lk(this->lock);
+	this->records.clear();
+
+	std::ifstream in(this->path);
+	std::string line;
+	size_t lines = 0;
+	while(std::getline(in, line)) {
+		std::istringstream fields(line);
+		std::string key;
+		Record r;
+		if(!(fields >> key >> r.hash >> r.started >> r.outcome >> r.total_ms >>
+		     r.fetch_ms >> r.prepare_ms >> r.commands_ms >> r.package_ms >> r.cpu_ms >>
+		     r.peak_rss_kb >> r.bytes_written)) {
+			continue;
+		}
+		if(r.hash == "-") {
+			r.hash.clear();
+		}
+		lines++;
+		auto &runs = this->records[key];
+		keep_run(&runs, std::move(r));
+	}
+	in.close();
+
+	if(lines <= 2 * this->records.size() * BuildHistory::runs_kept) {
+		return;
+	}
+
+	std::string tmp_path = this->path + ".tmp";
+	std::ofstream out(tmp_path);
+	for(auto &it : this->records) {
+		for(auto &r : it.second) {
+			write_record(out, it.first, r);
+		}
+	}
+	out.close();
+	if(out.good()) {
+		std::rename(tmp_path.c_str(), this->path.c_str());
+	}
+}
+
+/**
+ * Record a run of a package, appending it to the history file.
+ *
+ * @param key - The namespace/package name.
+ * @param r - The run.
+ */
+void BuildHistory::record(const std::string &key, const Record &r)
+{
+	std::unique_lock<std::mutex> lk(this->lock);
+	auto &runs = this->records[key];
+	keep_run(&runs, r);
+
+	std::ofstream out(this->path, std::ios::app);
+	write_record(out, key, r);
+}
+
+/**
+ * Get the latest run of a package that actually built it.
+ *
+ * @param key - The namespace/package name.
+ * @param r - Set to the run.
+ *
+ * @returns false if the package has never been built.
+ */
+bool BuildHistory::lastBuild(const std::string &key, Record *r) const
+{
+	std::unique_lock<std::mutex> lk(this->lock);
+	auto it = this->records.find(key);
+	if(it == this->records.end()) {
+		return false;
+	}
+	for(auto rit = it->second.rbegin(); rit != it->second.rend(); ++rit) {
+		if(rit->outcome == "built") {
+			*r = *rit;
+			return true;
+		}
+	}
+	return false;
+}
+
+/**
+ * Get the number of packages with a history.
+ *
+ * @returns The number of packages.
+ */
+size_t BuildHistory::size() const
+{
+	std::unique_lock<std::mutex> lk(this->lock);
+	return this->records.size();
+}
@@ -0,0 +1,81 @@
+/******************************************************************************
+ Copyright 2026 Allied Telesis Labs Ltd. All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+    1. Redistributions of source code must retain the above copyright notice,
+       this list of conditions and the following disclaimer.
+
+    2. Redistributions in binary form must reproduce the above copyright
+       notice, this list of conditions and the following disclaimer in the
+       documentation and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*******************************************************************************/
+
+#ifndef HISTORY_HPP_
+#define HISTORY_HPP_
+
+#include <cstdint>
+#include <ctime>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+namespace buildsys
+{
+	/**
+	 * A record of every package build, kept across runs. Each run of a package is
+	 * appended to a file as one line, keyed by the namespace/package name and build
+	 * info hash. The whole file is read at startup, keeping only the latest runs of
+	 * each package (and always the latest that built it), and rewritten when it has
+	 * grown too much.
+	 */
+	class BuildHistory
+	{
+	public:
+		//! A single run of a package
+		struct Record {
+			std::string hash;
+			time_t started{0};
+			//! One of "built", "cached", "current" or "failed"
+			std::string outcome;
+			int64_t total_ms{0};
+			int64_t fetch_ms{0};
+			int64_t prepare_ms{0};
+			int64_t commands_ms{0};
+			int64_t package_ms{0};
+			int64_t cpu_ms{0};
+			int64_t peak_rss_kb{0};
+			int64_t bytes_written{0};
+		};
+
+	private:
+		std::string path;
+		std::unordered_map<std::string, std::deque<Record>> records;
+		mutable std::mutex lock;
+
+	public:
+		explicit BuildHistory(std::string _path);
+		void load();
+		void record(const std::string &key, const Record &r);
+		bool lastBuild(const std::string &key, Record *r) const;
+		size_t size() const;
+
+		//! How many runs of each package are kept, including the latest that built it
+		static const size_t runs_kept = 8;
+	};
+} // namespace buildsys
+
+#endif // HISTORY_HPP_
@@ -0,0 +1,447 @@
+/******************************************************************************
+ Copyright 2026 Allied Telesis Labs Ltd. All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+    1. Redistributions of source code must retain the above copyright notice,
+       this list of conditions and the following disclaimer.
+
+    2. Redistributions in binary form must reproduce the above copyright
+       notice, this list of conditions and the following disclaimer in the
+       documentation and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*******************************************************************************/
+
+#include "http.hpp"
+#include <algorithm>
+#include <boost/algorithm/string.hpp>
+#include <cerrno>
+#include <cstdlib>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+#include <utility>
+
+using namespace buildsys;
+
+//! How long to wait for the server before giving up on a request
+static const time_t timeout_secs = 60;
+static const size_t read_size = 64 * 1024;
+
+/**
+ * Split a http:// URL into its parts.
+ *
+ * @param url - The URL.
+ * @param parsed - Filled with the parts of the URL.
+ *
+ * @returns true if the URL could be parsed, false otherwise (including for other
+ *          schemes).
+ */
+bool HttpUrl::parse(const std::string &url, HttpUrl *parsed)
+{
+	const std::string scheme = "http://";
+	if(url.compare(0, scheme.size(), scheme) != 0) {
+		return false;
+	}
+	size_t host_start = scheme.size();
+	size_t path_start = std::min(url.find('/', host_start), url.size());
+	std::string authority = url.substr(host_start, path_start - host_start);
+	if(authority.empty() || authority.find('@') != std::string::npos) {
+		return false;
+	}
+
+	size_t colon = authority.rfind(':');
+	if(colon != std::string::npos && authority.find(']', colon) == std::string::npos) {
+		parsed->host = authority.substr(0, colon);
+		parsed->port = authority.substr(colon + 1);
+	} else {
+		parsed->host = authority;
+		parsed->port = "80";
+	}
+	if(parsed->host.size() > 2 && parsed->host.front() == '[') {
+		parsed->host = parsed->host.substr(1, parsed->host.size() - 2);
+	}
+	parsed->path = url.substr(path_start);
+	while(!parsed->path.empty() && parsed->path.back() == '/') {
+		parsed->path.pop_back();
+	}
+	return !parsed->host.empty() && !parsed->port.empty();
+}
+
+/**
+ * Construct a HttpConnection. Nothing is connected until the first request.
+ *
+ * @param _host - The server name or address.
+ * @param _port - The server port.
+ */
+HttpConnection::HttpConnection(std::string _host, std::string _port)
+    : host(std::move(_host)), port(std::move(_port))
+{
+}
+
+/**
+ * Destroy the HttpConnection, closing the connection.
+ */
+HttpConnection::~HttpConnection()
+{
+	this->close();
+}
+
+/**
+ * Connect to the server.
+ *
+ * @returns true if connected, false otherwise.
+ */
+bool HttpConnection::open()
+{
+	addrinfo hints{};
+	hints.ai_family = AF_UNSPEC;
+	hints.ai_socktype = SOCK_STREAM;
+	addrinfo *addresses = nullptr;
+	if(getaddrinfo(this->host.c_str(), this->port.c_str(), &hints, &addresses) != 0) {
+		return false;
+	}
+
+	for(addrinfo *ai = addresses; ai != nullptr; ai = ai->ai_next) {
+		int sock = socket(ai->ai_family, ai->ai_socktype | SOCK_CLOEXEC, ai->ai_protocol);
+		if(sock < 0) {
+			continue;
+		}
+		timeval tv{timeout_secs, 0};
+		setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+		setsockopt(sock, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+		int one = 1;
+		setsockopt(sock, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+		if(connect(sock, ai->ai_addr, ai->ai_addrlen) == 0) {
+			this->fd = sock;
+			break;
+		}
+		::close(sock);
+	}
+	freeaddrinfo(addresses);
+
+	this->buffer.clear();
+	this->buffer_pos = 0;
+	return this->fd >= 0;
+}
+
+/**
+ * Close the connection, if it is open.
+ */
+void HttpConnection::close()
+{
+	if(this->fd >= 0) {
+		::close(this->fd);
+		this->fd = -1;
+	}
+}
+
+/**
+ * Send all of the given data.
+ *
+ * @param data - The data to send.
+ * @param length - The length of the data.
+ *
+ * @returns true if it was all sent, false otherwise.
+ */
+bool HttpConnection::sendAll(const char *data, size_t length)
+{
+	size_t sent = 0;
+	while(sent < length) {
+		ssize_t res = send(this->fd, data + sent, length - sent, MSG_NOSIGNAL);
+		if(res < 0 && errno == EINTR) {
+			continue;
+		}
+		if(res <= 0) {
+			return false;
+		}
+		sent += static_cast<size_t>(res);
+	}
+	return true;
+}
+
+/**
+ * Send the body of a request, as it is filled by the source.
+ *
+ * @param source - Where to get the body from.
+ * @param length - The length of the body.
+ *
+ * @returns true if it was all sent, false otherwise.
+ */
+bool HttpConnection::sendBody(const BodySource &source, size_t length)
+{
+	std::vector<char> data(std::min(length, read_size));
+	size_t offset = 0;
+	while(offset < length) {
+		size_t filled = source(offset, data.data(), std::min(length - offset, data.size()));
+		if(filled == 0 || !this->sendAll(data.data(), filled)) {
+			return false;
+		}
+		offset += filled;
+	}
+	return true;
+}
+
+/**
+ * Receive more data into the buffer, dropping what has been consumed.
+ *
+ * @returns true if more data was received, false on error or end of stream.
+ */
+bool HttpConnection::fill()
+{
+	this->buffer.erase(0, this->buffer_pos);
+	this->buffer_pos = 0;
+	size_t used = this->buffer.size();
+	this->buffer.resize(used + read_size);
+	ssize_t res = 0;
+	do {
+		res = recv(this->fd, &this->buffer[used], read_size, 0);
+	} while(res < 0 && errno == EINTR);
+	this->buffer.resize(used + static_cast<size_t>(std::max<ssize_t>(res, 0)));
+	return res > 0;
+}
+
+/**
+ * Read a line, ended by CRLF (or LF).
+ *
+ * @param line - Set to the line, without the line ending.
+ *
+ * @returns true if a line was read, false otherwise.
+ */
+bool HttpConnection::readLine(std::string *line)
+{
+	size_t end = 0;
+	while((end = this->buffer.find('\n', this->buffer_pos)) == std::string::npos) {
+		if(!this->fill()) {
+			return false;
+		}
+	}
+	*line = this->buffer.substr(this->buffer_pos, end - this->buffer_pos);
+	if(!line->empty() && line->back() == '\r') {
+		line->pop_back();
+	}
+	this->buffer_pos = end + 1;
+	return true;
+}
+
+/**
+ * Read part of a response body, passing it to the sink.
+ *
+ * @param length - The number of bytes to read, or SIZE_MAX to read until the server
+ *                 closes the connection.
+ * @param sink - Where to pass the data (may be empty).
+ *
+ * @returns true if all of the data was read and accepted, false otherwise.
+ */
+bool HttpConnection::readBody(size_t length, const BodySink &sink)
+{
+	bool to_close = (length == SIZE_MAX);
+	while(length > 0) {
+		if(this->buffer_pos == this->buffer.size() && !this->fill()) {
+			return to_close;
+		}
+		size_t available = std::min(length, this->buffer.size() - this->buffer_pos);
+		if(sink && !sink(this->buffer.data() + this->buffer_pos, available)) {
+			return false;
+		}
+		this->buffer_pos += available;
+		if(!to_close) {
+			length -= available;
+		}
+	}
+	return true;
+}
+
+/**
+ * Read a response body sent with the chunked transfer encoding.
+ *
+ * @param sink - Where to pass the data (may be empty).
+ *
+ * @returns true if all of the data was read and accepted, false otherwise.
+ */
+bool HttpConnection::readChunked(const BodySink &sink)
+{
+	std::string line;
+	while(true) {
+		if(!this->readLine(&line)) {
+			return false;
+		}
+		size_t length = 0;
+		try {
+			length = std::stoul(line, nullptr, 16);
+		} catch(std::exception &e) {
+			return false;
+		}
+		if(length == 0) {
+			break;
+		}
+		if(!this->readBody(length, sink) || !this->readLine(&line)) {
+			return false;
+		}
+	}
+	// Skip any trailers
+	do {
+		if(!this->readLine(&line)) {
+			return false;
+		}
+	} while(!line.empty());
+	return true;
+}
+
+/**
+ * Make a request, reusing the connection if it is still open.
+ *
+ * @param method - The request method (e.g. "GET", "HEAD" or "PUT").
+ * @param path - The path to request (starting with '/').
+ * @param sink - Where to pass the body of a successful (2xx) response, may be empty.
+ * @param source - Where to get the body of the request from, may be empty. It may be
+ *                 asked for the body more than once if the request is sent again.
+ * @param length - The length of the body of the request.
+ *
+ * @returns The response status, or -1 if the request failed.
+ */
+int HttpConnection::request(const std::string &method, const std::string &path,
+                            const BodySink &sink, const BodySource &source, size_t length)
+{
+	std::string req = method + " " + path + " HTTP/1.1\r\nHost: " + this->host +
+	                  "\r\nConnection: keep-alive\r\nUser-Agent: buildsys++\r\n";
+	if(source) {
+		req += "Content-Length: " + std::to_string(length) + "\r\n";
+	}
+	req += "\r\n";
+
+	std::string status_line;
+	for(int attempt = 0; attempt < 2; attempt++) {
+		// A connection kept open may have been closed by the server meanwhile, so a
+		// failure before any response is retried once on a new connection
+		bool reused = (this->fd >= 0);
+		if(!reused && !this->open()) {
+			return -1;
+		}
+		if(this->sendAll(req.data(), req.size()) &&
+		   (!source || this->sendBody(source, length)) && this->readLine(&status_line)) {
+			break;
+		}
+		this->close();
+		if(!reused) {
+			return -1;
+		}
+	}
+
+	// HTTP/1.1 200 OK
+	int status = -1;
+	size_t space = status_line.find(' ');
+	if(status_line.compare(0, 5, "HTTP/") == 0 && space != std::string::npos) {
+		status = std::atoi(status_line.c_str() + space + 1);
+	}
+	if(status < 100) {
+		this->close();
+		return -1;
+	}
+
+	size_t content_length = SIZE_MAX;
+	bool chunked = false;
+	bool keep_alive = (status_line.compare(0, 8, "HTTP/1.0") != 0);
+	std::string line;
+	while(true) {
+		if(!this->readLine(&line)) {
+			this->close();
+			return -1;
+		}
+		if(line.empty()) {
+			break;
+		}
+		size_t colon = line.find(':');
+		if(colon == std::string::npos) {
+			continue;
+		}
+		std::string name = boost::algorithm::to_lower_copy(line.substr(0, colon));
+		std::string value = boost::algorithm::trim_copy(line.substr(colon + 1));
+		boost::algorithm::to_lower(value);
+		if(name == "content-length") {
+			content_length = std::strtoull(value.c_str(), nullptr, 10);
+		} else if(name == "transfer-encoding") {
+			chunked = (value.find("chunked") != std::string::npos);
+		} else if(name == "connection") {
+			keep_alive = (value.find("close") == std::string::npos);
+		}
+	}
+
+	// Only successful responses are passed on, anything else is read and dropped
+	const BodySink &body_sink = (status >= 200 && status < 300) ? sink : nullptr;
+	bool complete = true;
+	if(method == "HEAD" || status == 204 || status == 304 || status < 200) {
+		// No body
+	} else if(chunked) {
+		complete = this->readChunked(body_sink);
+	} else {
+		if(content_length == SIZE_MAX) {
+			keep_alive = false;
+		}
+		complete = this->readBody(content_length, body_sink);
+	}
+
+	if(!complete || !keep_alive) {
+		this->close();
+	}
+	return complete ? status : -1;
+}
+
+/**
+ * Construct a HttpPool.
+ *
+ * @param _host - The server name or address.
+ * @param _port - The server port.
+ * @param _connections - The most connections to have open at once.
+ */
+HttpPool::HttpPool(std::string _host, std::string _port, size_t _connections)
+    : host(std::move(_host)), port(std::move(_port)),
+      connections(std::max<size_t>(_connections, 1))
+{
+}
+
+/**
+ * Take a connection, waiting for one to be given back if they are all in use.
+ *
+ * @returns The connection.
+ */
+std::unique_ptr<HttpConnection> HttpPool::take()
+{
+	std::unique_lock<std::mutex> lk(this->lock);
+	this->cond.wait(lk, [this] {
+		return !this->idle.empty() || this->created < this->connections;
+	});
+	if(!this->idle.empty()) {
+		auto connection = std::move(this->idle.back());
+		this->idle.pop_back();
+		return connection;
+	}
+	this->created++;
+	return std::make_unique<HttpConnection>(this->host, this->port);
+}
+
+/**
+ * Give a connection back, to be used again.
+ *
+ * @param connection - The connection.
+ */
+void HttpPool::give(std::unique_ptr<HttpConnection> connection)
+{
+	std::unique_lock<std::mutex> lk(this->lock);
+	this->idle.push_back(std::move(connection));
+	this->cond.notify_one();
+}
@@ -0,0 +1,115 @@
+/******************************************************************************
+ Copyright 2026 Allied Telesis Labs Ltd. All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+    1. Redistributions of source code must retain the above copyright notice,
+       this list of conditions and the following disclaimer.
+
+    2. Redistributions in binary form must reproduce the above copyright
+       notice, this list of conditions and the following disclaimer in the
+       documentation and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*******************************************************************************/
+
+#ifndef HTTP_HPP_
+#define HTTP_HPP_
+
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace buildsys
+{
+	//! The parts of a http:// URL
+	struct HttpUrl {
+		std::string host;
+		std::string port{"80"};
+		//! The path, without a trailing '/'
+		std::string path;
+		static bool parse(const std::string &url, HttpUrl *parsed);
+	};
+
+	/**
+	 * A HTTP/1.1 client connection to one server. The connection is kept open between
+	 * requests (and reopened when the server has closed it), so a series of requests
+	 * don't each pay for connecting.
+	 */
+	class HttpConnection
+	{
+	public:
+		//! Receives the body of a response, returns false to abandon the request
+		using BodySink = std::function<bool(const char *data, size_t length)>;
+		//! Fills part of the body of a request, starting at the given offset into it,
+		//! returns how much was filled (0 to abandon the request)
+		using BodySource = std::function<size_t(size_t offset, char *data, size_t length)>;
+
+	private:
+		const std::string host;
+		const std::string port;
+		int fd{-1};
+		//! Received bytes not yet consumed
+		std::string buffer;
+		size_t buffer_pos{0};
+		bool open();
+		void close();
+		bool sendAll(const char *data, size_t length);
+		bool sendBody(const BodySource &source, size_t length);
+		bool fill();
+		bool readLine(std::string *line);
+		bool readBody(size_t length, const BodySink &sink);
+		bool readChunked(const BodySink &sink);
+
+	public:
+		HttpConnection(std::string _host, std::string _port);
+		~HttpConnection();
+		HttpConnection(const HttpConnection &) = delete;
+		HttpConnection &operator=(const HttpConnection &) = delete;
+		HttpConnection(HttpConnection &&) = delete;
+		HttpConnection &operator=(HttpConnection &&) = delete;
+		int request(const std::string &method, const std::string &path,
+		            const BodySink &sink = nullptr, const BodySource &source = nullptr,
+		            size_t length = 0);
+	};
+
+	/**
+	 * A bounded set of connections to one server. Taking a connection waits until
+	 * one is free, so no more than the given number are ever open at once.
+	 */
+	class HttpPool
+	{
+	private:
+		const std::string host;
+		const std::string port;
+		const size_t connections;
+		size_t created{0};
+		std::vector<std::unique_ptr<HttpConnection>> idle;
+		std::mutex lock;
+		std::condition_variable cond;
+
+	public:
+		HttpPool(std::string _host, std::string _port, size_t _connections);
+		std::unique_ptr<HttpConnection> take();
+		void give(std::unique_ptr<HttpConnection> connection);
+		size_t size() const
+		{
+			return this->connections;
+		}
+	};
+} // namespace buildsys
+
+#endif // HTTP_HPP_
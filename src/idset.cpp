@@ -0,0 +1,138 @@
+/******************************************************************************
+ Copyright 2026 Allied Telesis Labs Ltd. All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+    1. Redistributions of source code must retain the above copyright notice,
+       this list of conditions and the following disclaimer.
+
+    2. Redistributions in binary form must reproduce the above copyright
+       notice, this list of conditions and the following disclaimer in the
+       documentation and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*******************************************************************************/
+
+#include "idset.hpp"
+#include <algorithm>
+
+using namespace buildsys;
+
+static const size_t bits_per_word = 64;
+
+/**
+ * Add an id to the set.
+ *
+ * @param id - The id to add.
+ */
+void IdSet::insert(size_t id)
+{
+	size_t index = id / bits_per_word;
+	uint64_t bit = uint64_t(1) << (id % bits_per_word);
+
+	auto it = std::lower_bound(
+	    this->words.begin(), this->words.end(), index,
+	    [](const std::pair<size_t, uint64_t> &word, size_t i) { return word.first < i; });
+	if(it != this->words.end() && it->first == index) {
+		it->second |= bit;
+	} else {
+		this->words.emplace(it, index, bit);
+	}
+}
+
+/**
+ * Add every id in another set to this set.
+ *
+ * @param other - The set to add.
+ */
+void IdSet::unite(const IdSet &other)
+{
+	if(other.words.empty()) {
+		return;
+	}
+
+	std::vector<std::pair<size_t, uint64_t>> merged;
+	merged.reserve(this->words.size() + other.words.size());
+	auto a = this->words.begin();
+	auto b = other.words.begin();
+	while(a != this->words.end() || b != other.words.end()) {
+		if(b == other.words.end() || (a != this->words.end() && a->first < b->first)) {
+			merged.push_back(*a++);
+		} else if(a == this->words.end() || b->first < a->first) {
+			merged.push_back(*b++);
+		} else {
+			merged.emplace_back(a->first, a->second | b->second);
+			a++;
+			b++;
+		}
+	}
+	this->words = std::move(merged);
+}
+
+/**
+ * Test whether an id is in the set.
+ *
+ * @param id - The id to look for.
+ *
+ * @returns true if the id is in the set.
+ */
+bool IdSet::contains(size_t id) const
+{
+	size_t index = id / bits_per_word;
+	auto it = std::lower_bound(
+	    this->words.begin(), this->words.end(), index,
+	    [](const std::pair<size_t, uint64_t> &word, size_t i) { return word.first < i; });
+	return it != this->words.end() && it->first == index &&
+	       (it->second & (uint64_t(1) << (id % bits_per_word))) != 0;
+}
+
+/**
+ * Count the ids in the set.
+ *
+ * @returns The number of ids.
+ */
+size_t IdSet::count() const
+{
+	size_t total = 0;
+	for(auto &word : this->words) {
+		total += static_cast<size_t>(__builtin_popcountll(word.second));
+	}
+	return total;
+}
+
+/**
+ * Test whether the set is empty.
+ *
+ * @returns true if there are no ids in the set.
+ */
+bool IdSet::empty() const
+{
+	return this->words.empty();
+}
+
+/**
+ * Call a function for every id in the set, in increasing order.
+ *
+ * @param func - The function to call with each id.
+ */
+void IdSet::for_each(const std::function<void(size_t)> &func) const
+{
+	for(auto &word : this->words) {
+		uint64_t bits = word.second;
+		while(bits != 0) {
+			auto bit = static_cast<size_t>(__builtin_ctzll(bits));
+			func(word.first * bits_per_word + bit);
+			bits &= bits - 1;
+		}
+	}
+}
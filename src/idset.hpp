@@ -0,0 +1,57 @@
+/******************************************************************************
+ Copyright 2026 Allied Telesis Labs Ltd. All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+    1. Redistributions of source code must retain the above copyright notice,
+       this list of conditions and the following disclaimer.
+
+    2. Redistributions in binary form must reproduce the above copyright
+       notice, this list of conditions and the following disclaimer in the
+       documentation and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*******************************************************************************/
+
+#ifndef IDSET_HPP_
+#define IDSET_HPP_
+
+#include <cstdint>
+#include <functional>
+#include <utility>
+#include <vector>
+
+namespace buildsys
+{
+	/**
+	 * A compressed bitset of dense ids (e.g. package ids). Only the non-zero 64 bit
+	 * words are stored, in order, so sets that cover a small part of a large id range
+	 * stay small, and taking the union of two sets is a merge of their words.
+	 */
+	class IdSet
+	{
+	private:
+		//! Non-zero words, sorted by their index
+		std::vector<std::pair<size_t, uint64_t>> words;
+
+	public:
+		void insert(size_t id);
+		void unite(const IdSet &other);
+		bool contains(size_t id) const;
+		size_t count() const;
+		bool empty() const;
+		void for_each(const std::function<void(size_t)> &func) const;
+	};
+} // namespace buildsys
+
+#endif // IDSET_HPP_
@@ -26,15 +26,19 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #ifndef INCLUDE_BUILDSYS_H_
 #define INCLUDE_BUILDSYS_H_
 
+#include <array>
 #include <atomic>
 #include <chrono>
 #include <condition_variable>
 #include <filesystem>
+#include <functional>
 #include <iostream>
 #include <list>
+#include <limits>
 #include <map>
 #include <memory>
 #include <mutex>
+#include <queue>
 #include <string>
 #include <thread>
 #include <unordered_set>
@@ -52,30 +56,26 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <boost/algorithm/string.hpp>
 #include <boost/config.hpp>
 #include <boost/format.hpp>
-#include <boost/graph/adjacency_list.hpp>
-#include <boost/graph/breadth_first_search.hpp>
-#include <boost/graph/connected_components.hpp>
-#include <boost/graph/depth_first_search.hpp>
-#include <boost/graph/graph_utility.hpp>
-#include <boost/graph/graphviz.hpp>
-#include <boost/graph/topological_sort.hpp>
-#include <boost/graph/visitors.hpp>
-#include <boost/property_map/property_map.hpp>
 #include <boost/utility.hpp>
 
+#include "../admission.hpp"
+#include "../buildcache.hpp"
 #include "../buildinfo.hpp"
 #include "../dir/builddir.hpp"
 #include "../exceptions.hpp"
 #include "../featuremap.hpp"
 #include "../hash.hpp"
+#include "../hashcache.hpp"
+#include "../history.hpp"
+#include "../idset.hpp"
+#include "../jobserver.hpp"
 #include "../logger.hpp"
 #include "../lua.hpp"
 #include "../namespace.hpp"
 #include "../packagecmd.hpp"
+#include "../threadpool.hpp"
 
-using Graph = boost::adjacency_list<boost::vecS, boost::vecS, boost::directedS>;
-using Vertex = boost::graph_traits<Graph>::vertex_descriptor;
-using Edge = boost::graph_traits<Graph>::edge_descriptor;
+using Vertex = size_t;
 
 namespace filesystem = std::filesystem; // NOLINT
 
@@ -154,6 +154,11 @@ namespace buildsys
 		{
 			return false;
 		};
+		//! Does this unit only download a file into dl/ ?
+		virtual bool is_download()
+		{
+			return false;
+		};
 		virtual std::string relative_path() = 0;
 	};
 
@@ -183,6 +188,10 @@ namespace buildsys
 		}
 		bool fetch(BuildDir *d) override;
 		std::string HASH() override;
+		bool is_download() override
+		{
+			return true;
+		};
 		std::string relative_path() override
 		{
 			return "dl/" + this->final_name();
@@ -190,38 +199,41 @@ namespace buildsys
 		static void setTarballCache(std::string cache);
 	};
 
-	/* A linked file/directory
+	/* A local file/directory, hashed over its contents
 	 */
-	class LinkFetch : public FetchUnit
+	class TreeFetch : public FetchUnit
 	{
+	protected:
+		std::string hash;
+
 	public:
-		LinkFetch(std::string uri, Package *_P) : FetchUnit(std::move(uri), _P)
+		TreeFetch(std::string uri, Package *_P) : FetchUnit(std::move(uri), _P)
 		{
 		}
-		bool fetch(BuildDir *d) override;
-		bool force_updated() override
-		{
-			return true;
-		};
 		std::string HASH() override;
 		std::string relative_path() override;
 	};
 
-	/* A copied file/directory
+	/* A linked file/directory
 	 */
-	class CopyFetch : public FetchUnit
+	class LinkFetch : public TreeFetch
 	{
 	public:
-		CopyFetch(std::string uri, Package *_P) : FetchUnit(std::move(uri), _P)
+		LinkFetch(std::string uri, Package *_P) : TreeFetch(std::move(uri), _P)
 		{
 		}
 		bool fetch(BuildDir *d) override;
-		bool force_updated() override
+	};
+
+	/* A copied file/directory
+	 */
+	class CopyFetch : public TreeFetch
+	{
+	public:
+		CopyFetch(std::string uri, Package *_P) : TreeFetch(std::move(uri), _P)
 		{
-			return true;
-		};
-		std::string HASH() override;
-		std::string relative_path() override;
+		}
+		bool fetch(BuildDir *d) override;
 	};
 
 	/** An extraction unit
@@ -367,6 +379,26 @@ namespace buildsys
 		std::string HASH() override;
 	};
 
+	//! A linked or copied file/directory, recorded so changes to it are noticed
+	class FetchedTreeExtractionUnit : public ExtractionUnit
+	{
+	private:
+		FetchUnit *fetched;
+
+	public:
+		explicit FetchedTreeExtractionUnit(FetchUnit *_fetched);
+		void print(std::ostream &out) override
+		{
+			out << this->type() << " " << this->uri << " " << this->HASH() << std::endl;
+		}
+		std::string type() override
+		{
+			return std::string("FetchedTree");
+		}
+		bool extract(Package *P) override;
+		std::string HASH() override;
+	};
+
 	//! A git directory as part of the extraction step
 	class GitDirExtractionUnit : public ExtractionUnit
 	{
@@ -474,6 +506,16 @@ namespace buildsys
 			}
 			return true;
 		};
+		//! Fetch only the units that download into dl/
+		bool download(BuildDir *d)
+		{
+			for(auto &unit : this->FUs) {
+				if(unit->is_download() && !unit->fetch(d)) {
+					return false;
+				}
+			}
+			return true;
+		};
 	};
 
 	/** An extraction description
@@ -531,6 +573,12 @@ namespace buildsys
 		static bool quiet_packages;
 		static bool keep_staging;
 		static bool extract_in_parallel;
+		static ThreadPool *thread_pool;
+		static JobServer *job_server;
+		static std::function<void(Package *)> staging_released_hook;
+		static BuildHistory *build_history;
+		static BuildCache *cache_client;
+		static CacheUploader *cache_uploader;
 		static std::string build_cache;
 		static bool clean_all_packages;
 		static std::list<std::string> overlays;
@@ -555,18 +603,47 @@ namespace buildsys
 		string_list installFiles;
 		bool processing_queued{false};
 		bool buildInfoPrepared{false};
+		//! Is what dependents record about us known before we are built ?
+		std::atomic<bool> build_info_final{false};
 		std::atomic<bool> built{false};
 		std::atomic<bool> building{false};
 		std::atomic<bool> was_built{false};
+		std::atomic<bool> staging_released{false};
+		bool fetched_from_cache{false};
+		//! What the build cache said about us when asked before building
+		BuildCache::Availability cache_availability{BuildCache::Availability::Unknown};
+		size_t id{std::numeric_limits<size_t>::max()};
+		IdSet staging_closure;
+		IdSet depended_closure;
+		bool closures_set{false};
+		bool needs_build{false};
 		bool codeUpdated{false};
 		bool hash_output{false};
+		int resource_cores{1};
+		uint64_t resource_memory{0};
 		bool suppress_remove_staging{false};
 		mutable std::mutex lock;
 		time_t run_secs{0};
+		std::chrono::microseconds process_time{0};
 		Logger logger;
 		bool clean_before_build{false};
+		std::mutex sources_lock;
+		bool sources_described{false};
+		bool sources_prepared{false};
+		//! Leave our output archives in the build cache unless something needs them
+		bool defer_artifacts{false};
+		std::mutex artifacts_lock;
+		bool artifacts_deferred{false};
+		bool fetchFromCache(const std::vector<std::array<std::string, 4>> &files);
+		bool fetchArtifacts();
+		bool fetchDeferredArtifacts();
+		void uploadToCache();
 		//! Set the buildinfo file hash from the new .build.info.new file
 		void updateBuildInfoHash();
+		//! Record a run of this package in the build history
+		void recordRun(BuildHistory::Record *record,
+		               std::chrono::steady_clock::time_point start,
+		               const std::string &outcome);
 		//! Set the buildinfo file hash from the existing .build.info file
 		void updateBuildInfoHashExisting();
 		bool extract_staging(const std::string &dir);
@@ -579,14 +656,17 @@ namespace buildsys
 		             const std::string &fext);
 		void common_init();
 		bool should_suppress_building();
+		void describeSources();
 
 	protected:
-		//! prepare the (new) build.info file
+		//! prepare the (new) build.info file, throws if a dependency has no build info
 		void prepareBuildInfo();
 		//! update the build.info file
 		void updateBuildInfo(bool updateOutputHash = true);
 		//! Attempt to fetchFrom
 		bool fetchFrom();
+		//! Fetch and extract the sources for this package (if not already done)
+		bool prepareSources();
 		//! Prepare the (new) staging/install directories for the building of this package
 		bool prepareBuildDirs();
 		//! Extract all dependencies install dirs for this package (if bd:fetch(,'deps') was
@@ -607,6 +687,8 @@ namespace buildsys
 
 	public:
 		enum class BuildInfoType { Output, Build };
+		//! The result of building, NeedsLocal means build again once locals are rebuilt
+		enum class BuildResult { Failed, Built, NeedsLocal };
 		/**
 		 * Create a package.
 		 *
@@ -681,9 +763,11 @@ namespace buildsys
 
 		/** Depend on another package
 		 *  \param p The package to depend on
+		 *  Throws if the dependency would close a dependency loop
 		 */
 		void depend(Package *P, bool locally)
 		{
+			NameSpace::addDependency(this, P);
 			this->depends.emplace_back(P, locally);
 		};
 		/** Set the location to extract install directories to
@@ -734,6 +818,11 @@ namespace buildsys
 		}
 		//! Parse and load the lua file for this package
 		bool process();
+		//! How long did parsing the lua file for this package take ?
+		std::chrono::microseconds getProcessTime() const
+		{
+			return this->process_time;
+		}
 		//! Remove the staging directory (to save space, if not suppressed)
 		void cleanStaging() const;
 		//! Sets the code updated flag
@@ -746,10 +835,6 @@ namespace buildsys
 		{
 			return this->codeUpdated;
 		};
-		/** Is this package ready for building yet ?
-		 *  \return true iff all all dependencies are built
-		 */
-		bool canBuild();
 		/** Is this package already built ?
 		 *  \return true if this package has already been built during this invocation of
 		 * buildsys
@@ -758,6 +843,10 @@ namespace buildsys
 		{
 			return this->built;
 		}
+		/** Get the packages whose install output this package extracts
+		 *  \param packages The set to fill (left empty if bd:fetch(,'deps') isn't used)
+		 */
+		void getInstallPackages(std::unordered_set<Package *> *packages);
 		//! Hash the output for this package
 		void setHashOutput(bool set)
 		{
@@ -768,10 +857,103 @@ namespace buildsys
 		{
 			return this->hash_output;
 		};
+		/** Declare the resources building this package is expected to use
+		 *  \param cores The number of cores kept busy
+		 *  \param memory The peak memory used, in MiB
+		 */
+		void setResources(int cores, uint64_t memory)
+		{
+			this->resource_cores = cores;
+			this->resource_memory = memory;
+		}
+		//! How many cores is building this package expected to use ?
+		int getResourceCores() const
+		{
+			return this->resource_cores;
+		}
+		//! How much memory (in MiB) is building this package expected to use ?
+		uint64_t getResourceMemory() const
+		{
+			return this->resource_memory;
+		}
+		/** Get the time taken to build this package the last time it was built
+		 *  \param secs Set to the build time in seconds
+		 *  \return false if there is no recorded build time
+		 */
+		bool getPreviousBuildTime(time_t *secs) const;
 		//! Return the build information for this package
 		BuildInfoType buildInfo(std::string *file_path, std::string *hash);
-		//! Build this package
-		bool build(bool locally = false);
+		/** Download the source files ahead of building
+		 *  This is independent of the dependencies, so can be run as soon as all
+		 *  packages are processed. Anything else (extraction, links and copies that
+		 *  may point at other packages) is left for the build.
+		 */
+		void prefetchSources();
+		/** Work out the build info hash before anything is built
+		 *  The dependencies must have been through this first
+		 *  \returns true if the hash is known, false if it is left for building
+		 */
+		bool prepareBuildInfoAhead();
+		//! The build info hash, empty until it is known
+		const std::string &getBuildInfoHash() const
+		{
+			return this->buildinfo_hash;
+		}
+		//! Record whether the build cache has our outputs, as found out before building
+		void setCacheAvailability(BuildCache::Availability availability)
+		{
+			this->cache_availability = availability;
+		}
+		BuildCache::Availability getCacheAvailability() const
+		{
+			return this->cache_availability;
+		}
+		/** Only fetch metadata when using the build cache for this package
+		 *  The output archives are fetched when a package being built extracts them
+		 */
+		void setDeferArtifacts(bool set)
+		{
+			this->defer_artifacts = set;
+		}
+		/** Build this package, the scheduler must have built its dependencies
+		 *  \param locally Rebuild for a package that depends on this one locally
+		 */
+		BuildResult build(bool locally = false);
+		//! Set the dense id of this package, given when it is added to a namespace
+		void setId(size_t _id)
+		{
+			this->id = _id;
+		}
+		//! Get the dense id of this package
+		size_t getId() const
+		{
+			return this->id;
+		}
+		/** Set the precomputed closures of this package
+		 *  \param staging The packages extracted into the staging directory
+		 *  \param depended The packages depended on, not looking inside intercepting ones
+		 */
+		void setClosures(IdSet staging, IdSet depended)
+		{
+			this->staging_closure = std::move(staging);
+			this->depended_closure = std::move(depended);
+			this->closures_set = true;
+		}
+		//! Get the precomputed staging closure (empty until the graph sets it)
+		const IdSet &getStagingClosure() const
+		{
+			return this->staging_closure;
+		}
+		//! Get the precomputed depended closure (empty until the graph sets it)
+		const IdSet &getDependedClosure() const
+		{
+			return this->depended_closure;
+		}
+		//! Has this package been built (or rebuilt locally) by this invocation ?
+		bool wasBuilt() const
+		{
+			return this->was_built;
+		}
 		//! Has building of this package already started ?
 		bool isBuilding() const
 		{
@@ -828,7 +1010,14 @@ namespace buildsys
 		static void set_quiet_packages(bool set);
 		static void set_keep_all_staging(bool set);
 		static void set_extract_in_parallel(bool set);
+		static void set_thread_pool(ThreadPool *pool);
+		static void set_job_server(JobServer *js);
+		static void set_staging_released_hook(std::function<void(Package *)> hook);
+		static void set_build_history(BuildHistory *history);
 		static void set_build_cache(std::string cache);
+		static void set_cache_client(BuildCache *client);
+		static void set_cache_uploader(CacheUploader *uploader);
+		static const std::string &get_build_cache();
 		static void set_clean_packages(bool set);
 		static void add_overlay_path(std::string path, bool top = false);
 		static void add_forced_package(std::string name);
@@ -839,110 +1028,88 @@ namespace buildsys
 	class Internal_Graph
 	{
 	private:
-		using NodeVertexMap = std::map<Package *, Vertex>;
-		using VertexNodeMap = std::map<Vertex, Package *>;
-		using container = std::vector<Vertex>;
-		Graph g;
-		NodeVertexMap Nodes;
-		VertexNodeMap NodeMap;
-		container c;
-
-		/**
-		 * Used to print out the names of packages in the dependency graph.
-		 */
-		class VertexNodeMap_property_writer
-		{
-		private:
-			const VertexNodeMap &map;
-
-		public:
-			/**
-			 * Construct a VertexNodeMap_property_writer
-			 *
-			 * @param _map - The VertexNodeMap of the graph (i.e. the mapping between
-			 *               vertices and packages).
-			 */
-			explicit VertexNodeMap_property_writer(const VertexNodeMap &_map) : map(_map)
-			{
-			}
-			/**
-			 * The outputting function for each vertex in the graph (i.e. each package).
-			 *
-			 * @param out - The stream to write the data to
-			 * @param v - The vertex to write the data for
-			 */
-			void operator()(std::ostream &out, Vertex v)
-			{
-				if(this->map.at(v) != nullptr) {
-					this->map.at(v)->printLabel(out);
-				}
-			}
-		};
+		//! The packages, indexed by their id
+		std::vector<Package *> nodes;
+		//! Dependencies of v are depends_to[depends_start[v]] up to depends_start[v + 1]
+		std::vector<size_t> depends_start;
+		std::vector<Vertex> depends_to;
+		std::vector<bool> depends_locally;
+		//! The same edges reversed, giving the vertices that depend on each vertex
+		std::vector<size_t> dependents_start;
+		std::vector<Vertex> dependents_from;
+		std::vector<bool> dependents_locally;
+		//! The vertices that extract the install output of each vertex (in the same form)
+		std::vector<size_t> install_start;
+		std::vector<Vertex> install_from;
+		//! Number of unbuilt dependencies for each vertex
+		std::vector<size_t> pending;
+		//! Has the staging output of each vertex been released ?
+		std::vector<bool> released;
+		//! Has each vertex been built ?
+		std::vector<bool> finished;
+		size_t finished_count{0};
+		//! Has a local rebuild of each vertex been queued, and has it finished ?
+		std::vector<bool> local_requested;
+		std::vector<bool> local_done;
+		//! Number of unfinished local rebuilds that each local rebuild needs first
+		std::vector<size_t> local_pending;
+		//! Number of unfinished local rebuilds each deferred package is waiting for
+		std::vector<size_t> resume_pending;
+		//! Who is waiting for the local rebuild of each vertex (true for local rebuilds)
+		std::vector<std::vector<std::pair<Vertex, bool>>> local_waiters;
+		//! Local rebuilds with no unfinished local rebuilds before them
+		std::queue<Vertex> local_ready;
+		void requestLocalBuild(Vertex l);
+		//! Length of the longest path (in seconds) from each vertex to the top of the graph
+		std::vector<time_t> priority;
+		//! Vertices with no unbuilt dependencies, longest remaining path first
+		std::priority_queue<std::pair<time_t, Vertex>> ready;
+		//! Every vertex, longest remaining path first, and the first one not yet built
+		std::vector<Vertex> by_priority;
+		size_t longest_unbuilt{0};
+		void releaseDependent(Vertex v);
+		std::vector<Vertex> topologicalOrder() const;
 
 	public:
 		//! Fill the Internal_Graph
 		void fill();
 		//! Output the graph to dependencies.dot
 		void output() const;
-		//! Perform a topological sort
-		void topological();
-		//! Find a package with no dependencies
+		//! Give every package its staging and depended closures
+		void computeClosures();
+		//! Run a function on every package, after running it on its dependencies
+		void forEachInOrder(ThreadPool *pool,
+		                    const std::function<void(Package *)> &func) const;
+		//! Find the packages given, and every package that depends on them
+		IdSet dependentClosure(const std::vector<Package *> &packages) const;
+		//! Prepare the dependency counters and ready queue for scheduling
+		void prepareSchedule();
+		//! Take the next package that has no unbuilt dependencies (or nullptr)
 		Package *topoNext();
-		//! Remove a package from this graph
-		void deleteNode(Package *p);
-		std::unordered_set<Package *> get_cycled_packages() const;
-	};
-
-	class PackageQueue
-	{
-	private:
-		std::list<Package *> queue;
-		mutable std::mutex lock;
-		mutable std::condition_variable cond;
-		int started{0};
-		int finished{0};
-
-	public:
-		void start()
-		{
-			std::unique_lock<std::mutex> lk(this->lock);
-			this->started++;
-		}
-		void finish()
-		{
-			std::unique_lock<std::mutex> lk(this->lock);
-			this->finished++;
-			this->cond.notify_all();
-		}
-		void push(Package *p)
-		{
-			std::unique_lock<std::mutex> lk(this->lock);
-			queue.push_back(p);
-		}
-		Package *pop()
-		{
-			std::unique_lock<std::mutex> lk(this->lock);
-			Package *p = nullptr;
-			if(!this->queue.empty()) {
-				p = this->queue.front();
-				this->queue.pop_front();
-			}
-			return p;
+		//! Take the next package that has no unbuilt dependencies and fits (or nullptr)
+		Package *topoNext(const std::function<bool(Package *)> &fits);
+		//! Mark the staging output of a package final, releasing dependents that are ready
+		void packageStagingReleased(Package *p);
+		//! Mark a package as built, releasing any dependents that are now ready
+		void packageBuilt(Package *p);
+		//! Queue the local rebuilds a package needs, it is ready again once they are done
+		void packageNeedsLocalBuilds(Package *p);
+		//! Take the next package that is ready to be rebuilt locally (or nullptr)
+		Package *localNext();
+		//! Mark a package as rebuilt locally, releasing anything waiting on it
+		void packageLocallyBuilt(Package *p);
+		//! How many packages have been built
+		size_t builtCount() const
+		{
+			return this->finished_count;
 		}
-		bool done() const
+		//! How many packages are in the graph
+		size_t size() const
 		{
-			std::unique_lock<std::mutex> lk(this->lock);
-			return (this->started == this->finished) && this->queue.empty();
-		}
-		void wait() const
-		{
-			std::unique_lock<std::mutex> lk(this->lock);
-			if(this->started != this->finished) {
-				if(this->queue.empty()) {
-					this->cond.wait(lk);
-				}
-			}
+			return this->finished.size();
 		}
+		//! Estimate how long (in seconds) the rest of the build will take
+		time_t remainingTime() const;
 	};
 
 	//! The world, everything that everything needs to access
@@ -957,7 +1124,40 @@ namespace buildsys
 		mutable std::condition_variable cond;
 		std::atomic<int> threads_running{0};
 		int threads_limit{0};
+		int capacity_cores{0};
+		uint64_t capacity_memory{0};
+		int cores_in_use{0};
+		uint64_t memory_in_use{0};
+		std::unique_ptr<JobServer> jobserver;
+		std::unique_ptr<AdmissionControl> admission;
+		std::unique_ptr<BuildHistory> history;
+		std::unique_ptr<ThreadPool> pool;
+		std::unique_ptr<ThreadPool> fetch_pool;
 		std::list<Package *> failed_packages;
+		//! The queries to answer (the kind of query, and what it is about)
+		std::vector<std::pair<std::string, std::string>> queries;
+		bool runQueries();
+		size_t cache_connections{16};
+		bool lazy_cache{false};
+		bool cache_upload{false};
+		std::unique_ptr<BuildCache> cache;
+		std::unique_ptr<CacheUploader> uploader;
+		void probeBuildCache();
+		void deferCacheArtifacts(Package *base);
+		void startCacheUploads();
+		void finishCacheUploads();
+		bool buildBasePackage(const std::string &filename);
+		void stopPools();
+
+		// A package is never accounted as needing more than the whole host
+		int coresNeeded(Package *p) const
+		{
+			return std::min(p->getResourceCores(), this->capacity_cores);
+		}
+		uint64_t memoryNeeded(Package *p) const
+		{
+			return std::min(p->getResourceMemory(), this->capacity_memory);
+		}
 
 	public:
 		/** Are we operating in 'parse only' mode
@@ -991,12 +1191,43 @@ namespace buildsys
 			this->keepGoing = true;
 		}
 
+		/** Add a query to answer once everything is parsed, instead of building
+		 *  \param kind "rdeps" for a package (as namespace,package) or "feature"
+		 *  \param subject The package or feature to query
+		 */
+		void addQuery(const std::string &kind, const std::string &subject)
+		{
+			this->queries.emplace_back(kind, subject);
+			this->parseOnly = true;
+		}
+		//! Set the most connections to have open to the build cache at once
+		void setCacheConnections(size_t connections)
+		{
+			this->cache_connections = connections;
+		}
+		//! Only fetch the outputs of cached packages that are needed locally
+		void setLazyCache()
+		{
+			this->lazy_cache = true;
+		}
+		//! Upload the outputs of the packages that get built to the build cache
+		void setCacheUpload()
+		{
+			this->cache_upload = true;
+		}
+		//! Are there any queries to answer
+		bool hasQueries() const
+		{
+			return !this->queries.empty();
+		}
+
 		//! Start the processing and building steps with the given meta package
 		bool basePackage(const std::string &filename);
 
 		//! Tell everything that we have failed
 		void setFailed(Package *p)
 		{
+			std::unique_lock<std::mutex> lk(this->cond_lock);
 			this->failed_packages.push_back(p);
 			this->failed = true;
 		};
@@ -1007,19 +1238,48 @@ namespace buildsys
 		}
 		//! Declare a package built
 		bool packageFinished(Package *_p);
+		//! Declare the staging output of a package final
+		void packageStagingReleased(Package *_p);
+		//! Declare a package waiting for its locally depended packages to be rebuilt
+		void packageNeedsLocalBuilds(Package *_p);
+		//! Declare a package rebuilt locally
+		void packageLocallyBuilt(Package *_p);
 
-		//! A thread has started
-		void threadStarted()
+		//! A thread has started building a package
+		void threadStarted(Package *p)
 		{
 			this->threads_running++;
+			this->cores_in_use += this->coresNeeded(p);
+			this->memory_in_use += this->memoryNeeded(p);
 		}
-		//! A thread has finished
-		void threadEnded()
+		//! A thread has finished building a package
+		void threadEnded(Package *p)
 		{
 			std::unique_lock<std::mutex> lk(this->cond_lock);
 			this->threads_running--;
+			this->cores_in_use -= this->coresNeeded(p);
+			this->memory_in_use -= this->memoryNeeded(p);
 			this->cond.notify_all();
 		};
+		/** Set the capacity of the host that packages are fitted into
+		 *  \param cores The number of cores
+		 *  \param memory The amount of memory, in MiB
+		 */
+		void setCapacity(int cores, uint64_t memory)
+		{
+			this->capacity_cores = cores;
+			this->capacity_memory = memory;
+		}
+		//! Does building a package fit in the capacity that isn't in use ?
+		bool packageFits(Package *p) const
+		{
+			// Something has to run, even if it is bigger than the host
+			if(this->threads_running == 0) {
+				return true;
+			}
+			return this->cores_in_use + this->coresNeeded(p) <= this->capacity_cores &&
+			       this->memory_in_use + this->memoryNeeded(p) <= this->capacity_memory;
+		}
 		//! How many threads are currently running ?
 		int threadsRunning() const
 		{
@@ -1035,6 +1295,27 @@ namespace buildsys
 		{
 			return this->threads_limit;
 		}
+		/** Adjust the thread limit from the load on the host
+		 *  \param min The fewest packages to build at once
+		 *  \param max The most packages to build at once
+		 */
+		void setAdaptiveThreadsLimit(int min, int max)
+		{
+			this->admission = std::make_unique<AdmissionControl>(min, max);
+		}
+		/** Share a budget of jobs between package builds and make
+		 *  \param jobs The number of jobs that may run at once
+		 */
+		void setJobs(int jobs)
+		{
+			this->jobserver = std::make_unique<JobServer>(jobs);
+			Package::set_job_server(this->jobserver.get());
+		}
+		//! Get the pool of threads used for processing and building packages
+		ThreadPool *getThreadPool() const
+		{
+			return this->pool.get();
+		}
 	};
 } // namespace buildsys
 
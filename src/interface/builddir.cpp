@@ -196,6 +196,7 @@ static int li_bd_fetch(lua_State *L)
 			throw CustomException("fetch method = link requires uri to be set");
 		}
 		f = std::make_unique<LinkFetch>(uri, P);
+		P->extraction()->add(std::make_unique<FetchedTreeExtractionUnit>(f.get()));
 	} else if(method == "copyfile") {
 		if(uri.empty()) {
 			throw CustomException("fetch method = copyfile requires uri to be set");
@@ -213,6 +214,7 @@ static int li_bd_fetch(lua_State *L)
 			throw CustomException("fetch method = copy requires uri to be set");
 		}
 		f = std::make_unique<CopyFetch>(uri, P);
+		P->extraction()->add(std::make_unique<FetchedTreeExtractionUnit>(f.get()));
 	} else if(method == "deps") {
 		std::string path = absolute_path(d, to);
 		// record this directory (need to complete this operation later)
@@ -26,6 +26,7 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include "include/buildsys.h"
 #include "interface/builddir.hpp"
 #include "interface/luainterface.h"
+#include <cmath>
 #include <sys/stat.h>
 
 static int li_name(lua_State *L)
@@ -303,6 +304,68 @@ static int li_hashoutput(lua_State *L)
 	return 0;
 }
 
+//! The most memory (in MiB) a package may declare, any more can't be held exactly
+static const double max_memory_mib = 9007199254740992.0;
+
+/**
+ * Get a whole number given to resources() from the top of the lua stack.
+ *
+ * @param L - The lua state.
+ * @param key - The resource being set.
+ * @param min - The smallest value allowed.
+ * @param max - The largest value allowed.
+ *
+ * @returns The value.
+ */
+static double resource_value(lua_State *L, const std::string &key, double min, double max)
+{
+	if(lua_type(L, -1) != LUA_TNUMBER) {
+		throw CustomException("resources() " + key + " must be a number");
+	}
+	double value = lua_tonumber(L, -1);
+	// Written so that NaN fails the range check
+	if(!(value >= min && value <= max) || std::floor(value) != value) {
+		throw CustomException("resources() " + key + " must be a " +
+		                      ((min > 0) ? "positive" : "non-negative") + " integer");
+	}
+	return value;
+}
+
+static int li_resources(lua_State *L)
+{
+	if(lua_gettop(L) != 1 || !lua_istable(L, 1)) {
+		throw CustomException("resources() requires a table as the only argument");
+	}
+
+	Package *P = li_get_package();
+	int cores = P->getResourceCores();
+	uint64_t memory = P->getResourceMemory();
+
+	lua_pushnil(L); /* first key */
+	while(lua_next(L, 1) != 0) {
+		/* uses 'key' (at index -2) and 'value' (at index -1) */
+		if(lua_type(L, -2) != LUA_TSTRING) {
+			throw CustomException("resources() requires a table with strings as keys");
+		}
+		std::string key(lua_tostring(L, -2));
+		if(key == "cores") {
+			cores = static_cast<int>(
+			    resource_value(L, key, 1, std::numeric_limits<int>::max()));
+		} else if(key == "memory") {
+			// The peak memory, in MiB
+			memory = static_cast<uint64_t>(resource_value(L, key, 0, max_memory_mib));
+		} else {
+			throw CustomException("resources() does not know about " + key);
+		}
+		/* removes 'value'; keeps 'key' for next iteration */
+		lua_pop(L, 1);
+	}
+
+	// Used by the scheduler to avoid running too many heavy builds at once
+	P->setResources(cores, memory);
+	return 0;
+}
+
 static int li_require(lua_State *L)
 {
 	if(lua_gettop(L) != 1) {
@@ -382,6 +445,7 @@ bool buildsys::interfaceSetup(Lua *lua)
 	lua->registerFunc("keepstaging", li_keepstaging);
 	lua->registerFunc("name", li_name);
 	lua->registerFunc("hashoutput", li_hashoutput);
+	lua->registerFunc("resources", li_resources);
 	lua->registerFunc("require", li_require);
 	lua->registerFunc("optionally_require", li_optionally_require);
 	lua->registerFunc("overlayadd", li_overlay_add);
@@ -0,0 +1,163 @@
+/******************************************************************************
+ Copyright 2026 Allied Telesis Labs Ltd. All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+    1. Redistributions of source code must retain the above copyright notice,
+       this list of conditions and the following disclaimer.
+
+    2. Redistributions in binary form must reproduce the above copyright
+       notice, this list of conditions and the following disclaimer in the
+       documentation and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*******************************************************************************/
+
+#include "jobserver.hpp"
+#include "exceptions.hpp"
+#include <boost/format.hpp>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+
+using namespace buildsys;
+
+/**
+ * Construct the JobServer, creating the token pipe.
+ *
+ * @param _tokens - The number of jobs that may run at once.
+ */
+JobServer::JobServer(int _tokens) : tokens(_tokens)
+{
+	if(this->tokens < 1) {
+		throw CustomException("The jobserver requires at least 1 job");
+	}
+
+	int fds[2]; // NOLINT
+	if(pipe2(fds, O_CLOEXEC) != 0) {
+		throw CustomException("pipe() failed: " + std::string(strerror(errno)));
+	}
+	this->read_fd = fds[0];
+	this->write_fd = fds[1];
+
+	for(int i = 0; i < this->tokens; i++) {
+		this->release();
+	}
+}
+
+/**
+ * Destroy the JobServer, closing the token pipe.
+ */
+JobServer::~JobServer()
+{
+	close(this->read_fd);
+	close(this->write_fd);
+}
+
+/**
+ * Take a token from the pipe, waiting until one is available.
+ */
+void JobServer::acquire()
+{
+	char token;
+	while(read(this->read_fd, &token, 1) != 1) {
+		if(errno != EINTR) {
+			throw CustomException("Reading jobserver token failed: " +
+			                      std::string(strerror(errno)));
+		}
+	}
+}
+
+/**
+ * Return a token to the pipe.
+ */
+void JobServer::release()
+{
+	const char token = '+';
+	while(write(this->write_fd, &token, 1) != 1) {
+		if(errno != EINTR) {
+			throw CustomException("Writing jobserver token failed: " +
+			                      std::string(strerror(errno)));
+		}
+	}
+}
+
+/**
+ * Get the number of jobs that may run at once.
+ *
+ * @returns The number of tokens.
+ */
+int JobServer::getTokens() const
+{
+	return this->tokens;
+}
+
+/**
+ * Get the read end of the token pipe.
+ *
+ * @returns The file descriptor.
+ */
+int JobServer::getReadFd() const
+{
+	return this->read_fd;
+}
+
+/**
+ * Get the write end of the token pipe.
+ *
+ * @returns The file descriptor.
+ */
+int JobServer::getWriteFd() const
+{
+	return this->write_fd;
+}
+
+/**
+ * Get the MAKEFLAGS that connect a make invocation to this jobserver.
+ *
+ * @returns The flags.
+ */
+std::string JobServer::makeFlags() const
+{
+	auto flags = boost::format{"-j%1% --jobserver-auth=%2%,%3%"} % this->tokens %
+	             this->read_fd % this->write_fd;
+	return flags.str();
+}
+
+/**
+ * Take a token from the jobserver, waiting until one is available.
+ *
+ * @param _js - The jobserver, or nullptr if there is none.
+ */
+JobToken::JobToken(JobServer *_js) : js(_js)
+{
+	if(this->js != nullptr) {
+		this->js->acquire();
+	}
+}
+
+/**
+ * Return the token to the jobserver.
+ */
+JobToken::~JobToken()
+{
+	if(this->js == nullptr) {
+		return;
+	}
+	try {
+		this->js->release();
+	} catch(std::exception &e) {
+		// Nothing more can be done with the token, and destructors must not throw
+	}
+}
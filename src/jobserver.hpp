@@ -0,0 +1,81 @@
+/******************************************************************************
+ Copyright 2026 Allied Telesis Labs Ltd. All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+    1. Redistributions of source code must retain the above copyright notice,
+       this list of conditions and the following disclaimer.
+
+    2. Redistributions in binary form must reproduce the above copyright
+       notice, this list of conditions and the following disclaimer in the
+       documentation and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*******************************************************************************/
+
+#ifndef JOBSERVER_HPP_
+#define JOBSERVER_HPP_
+
+#include <string>
+
+namespace buildsys
+{
+	/**
+	 * A GNU make compatible jobserver. A fixed number of job tokens are held in a pipe,
+	 * building a package takes one token and any make run by the package draws further
+	 * tokens from the same pipe. This keeps package and command level parallelism
+	 * within one budget. The pipe is close-on-exec, so only the commands it is
+	 * explicitly passed to can see it.
+	 */
+	class JobServer
+	{
+	private:
+		int read_fd{-1};
+		int write_fd{-1};
+		int tokens{0};
+
+	public:
+		explicit JobServer(int _tokens);
+		~JobServer();
+		JobServer(const JobServer &) = delete;
+		JobServer &operator=(const JobServer &) = delete;
+		JobServer(JobServer &&) = delete;
+		JobServer &operator=(JobServer &&) = delete;
+		void acquire();
+		void release();
+		int getTokens() const;
+		std::string makeFlags() const;
+		int getReadFd() const;
+		int getWriteFd() const;
+	};
+
+	/**
+	 * A jobserver token held for the lifetime of this object, so the token is
+	 * returned however the holder exits. Without a jobserver this does nothing.
+	 */
+	class JobToken
+	{
+	private:
+		JobServer *js;
+
+	public:
+		explicit JobToken(JobServer *_js);
+		~JobToken();
+		JobToken(const JobToken &) = delete;
+		JobToken &operator=(const JobToken &) = delete;
+		JobToken(JobToken &&) = delete;
+		JobToken &operator=(JobToken &&) = delete;
+	};
+} // namespace buildsys
+
+#endif // JOBSERVER_HPP_
@@ -87,15 +87,19 @@ int main(int argc, char *argv[])
 		filesystem::create_directories("output");
 	}
 
+	// Files that haven't changed since the last run aren't hashed again
+	HashCache hash_cache("output/hash.db");
+	hash_cache.load();
+	hash_set_cache(&hash_cache);
+
 	if(!WORLD.basePackage(filename)) {
 		logger.log("Building: Failed");
-		if(WORLD.areKeepGoing()) {
-			hash_shutdown();
-		}
+		hash_set_cache(nullptr);
+		hash_shutdown();
 		return -1;
 	}
 
-	if(WORLD.areParseOnly()) {
+	if(WORLD.areParseOnly() && !WORLD.hasQueries()) {
 		// Print all the feature/values
 		li_get_feature_map()->printFeatureValues(std::cout);
 		NameSpace::printNameSpaces();
@@ -107,12 +111,15 @@ int main(int argc, char *argv[])
 	graph.output();
 
 	logger.log("Finished: " + target);
+	logger.log(boost::format{"Hashed %1% files, %2% were unchanged"} %
+	           (hash_cache.getHits() + hash_cache.getMisses()) % hash_cache.getHits());
 
 	steady_clock::time_point end = steady_clock::now();
 	auto duration = duration_cast<std::chrono::milliseconds>(end - start).count();
 	logger.log(boost::format{"Total time: %1%s and %2%ms"} % (duration / 1000) %
 	           (duration % 1000));
 
+	hash_set_cache(nullptr);
 	hash_shutdown();
 
 	return 0;
@@ -24,6 +24,7 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 *******************************************************************************/
 
 #include "namespace.hpp"
+#include "dependencyorder.hpp"
 #include "include/buildsys.h"
 #include <utility>
 
@@ -31,6 +32,24 @@ using namespace buildsys;
 
 static std::list<NameSpace> namespaces;
 static std::mutex namespaces_lock;
+//! Every package, indexed by its id
+static std::vector<Package *> packages_by_id;
+static std::mutex packages_by_id_lock;
+//! Every package, ordered so each comes after the packages it depends on
+static DependencyOrder dependency_order;
+
+/**
+ * Give a package the next id.
+ *
+ * @param p - The package.
+ */
+static void register_package(Package *p)
+{
+	std::unique_lock<std::mutex> lk(packages_by_id_lock);
+	p->setId(packages_by_id.size());
+	packages_by_id.push_back(p);
+	dependency_order.addVertex(p->getId());
+}
 
 /**
  * Construct the NameSpace object.
@@ -151,6 +170,7 @@ Package *NameSpace::findPackage(const std::string &_name)
 	// Package not found, create it
 	std::unique_ptr<Package> p = std::make_unique<Package>(this, _name);
 	Package *ret = p.get();
+	register_package(ret);
 	this->packages.push_back(std::move(p));
 
 	return ret;
@@ -163,6 +183,7 @@ Package *NameSpace::findPackage(const std::string &_name)
  */
 void NameSpace::addPackage(std::unique_ptr<Package> p)
 {
+	register_package(p.get());
 	std::unique_lock<std::mutex> lk(this->lock);
 	this->packages.push_back(std::move(p));
 }
@@ -174,4 +195,70 @@ void NameSpace::deleteAll()
 {
 	std::unique_lock<std::mutex> lk(namespaces_lock);
 	namespaces.clear();
+
+	std::unique_lock<std::mutex> ids_lk(packages_by_id_lock);
+	packages_by_id.clear();
+	dependency_order.clear();
+}
+
+/**
+ * Get the number of packages in all namespaces. Package ids run from 0 to one less
+ * than this.
+ *
+ * @returns The number of packages.
+ */
+size_t NameSpace::packageCount()
+{
+	std::unique_lock<std::mutex> lk(packages_by_id_lock);
+	return packages_by_id.size();
+}
+
+/**
+ * Find a package by its id.
+ *
+ * @param id - The id of the package.
+ *
+ * @returns The package.
+ */
+Package *NameSpace::packageById(size_t id)
+{
+	std::unique_lock<std::mutex> lk(packages_by_id_lock);
+	return packages_by_id.at(id);
+}
+
+/**
+ * Record that one package depends on another, keeping the dependency order up to date.
+ *
+ * @param from - The package that has the dependency.
+ * @param to - The package depended on.
+ *
+ * @throws DependencyLoopException if the dependency would close a dependency loop.
+ */
+void NameSpace::addDependency(Package *from, Package *to)
+{
+	std::vector<size_t> loop;
+	if(dependency_order.addDependency(from->getId(), to->getId(), &loop)) {
+		return;
+	}
+
+	std::string path;
+	for(auto id : loop) {
+		Package *p = NameSpace::packageById(id);
+		if(!path.empty()) {
+			path += " -> ";
+		}
+		path += p->getNS()->getName() + "," + p->getName();
+	}
+	throw DependencyLoopException(path);
+}
+
+/**
+ * Get every package id, ordered so that each package comes after the packages it
+ * depends on.
+ *
+ * @returns The package ids in order.
+ */
+std::vector<size_t> NameSpace::dependencyOrder()
+{
+	return dependency_order.getOrder();
 }
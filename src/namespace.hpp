@@ -31,6 +31,7 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <memory>
 #include <mutex>
 #include <string>
+#include <vector>
 
 namespace buildsys
 {
@@ -58,6 +59,10 @@ namespace buildsys
 		static void printNameSpaces();
 		static NameSpace *findNameSpace(const std::string &name);
 		static void deleteAll();
+		static size_t packageCount();
+		static Package *packageById(size_t id);
+		static void addDependency(Package *from, Package *to);
+		static std::vector<size_t> dependencyOrder();
 	};
 } // namespace buildsys
 
@@ -55,15 +55,39 @@ std::string buildsys::parse_command_line(int argc, char *argv[], World *WORLD)
 		} else if(argList[a] == "--cache-server") {
 			Package::set_build_cache(argList[a + 1]);
 			a++;
+		} else if(argList[a] == "--cache-connections") {
+			WORLD->setCacheConnections(std::stoul(argList[a + 1]));
+			a++;
+		} else if(argList[a] == "--cache-lazy") {
+			WORLD->setLazyCache();
+		} else if(argList[a] == "--cache-upload") {
+			WORLD->setCacheUpload();
 		} else if(argList[a] == "--tarball-cache") {
 			DownloadFetch::setTarballCache(argList[a + 1]);
 			a++;
 		} else if(argList[a] == "--overlay") {
 			Package::add_overlay_path(argList[a + 1]);
 			a++;
+		} else if(argList[a] == "--hash-algorithm") {
+			HashAlgorithm algorithm = HashAlgorithm::SHA256;
+			if(!hash_algorithm_from_name(argList.at(a + 1), &algorithm)) {
+				throw CustomException("Unknown hash algorithm: " + argList[a + 1]);
+			}
+			hash_set_algorithm(algorithm);
+			// Build info hashed with SHA256 is left as it was, so it (and the build
+			// cache keys) stay the same
+			BuildDescription::set_hash_algorithm(
+			    (algorithm == HashAlgorithm::SHA256) ? "" : argList[a + 1]);
+			a++;
 		} else if(argList[a] == "--build-info-ignore-fv") {
 			ignored_features.push_back(argList[a + 1]);
 			a++;
+		} else if(argList[a] == "--query-rdeps") {
+			WORLD->addQuery("rdeps", argList.at(a + 1));
+			a++;
+		} else if(argList[a] == "--query-feature") {
+			WORLD->addQuery("feature", argList.at(a + 1));
+			a++;
 		} else if(argList[a] == "--parse-only") {
 			WORLD->setParseOnly();
 		} else if(argList[a] == "--keep-going") {
@@ -78,6 +102,13 @@ std::string buildsys::parse_command_line(int argc, char *argv[], World *WORLD)
 			// in parallel.
 			Package::set_extract_in_parallel(false);
 			a++;
+		} else if(argList[a] == "--adaptive-packages") {
+			WORLD->setAdaptiveThreadsLimit(std::stoi(argList[a + 1]),
+			                               std::stoi(argList[a + 2]));
+			a += 2;
+		} else if(argList[a] == "--jobs") {
+			WORLD->setJobs(std::stoi(argList[a + 1]));
+			a++;
 		} else if(argList[a] == "--") {
 			foundDashDash = true;
 		} else {
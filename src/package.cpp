@@ -31,12 +31,19 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #endif
 
 using std::chrono::duration_cast;
+using std::chrono::milliseconds;
 using std::chrono::steady_clock;
 
 bool Package::quiet_packages = false;
 bool Package::keep_staging = false;
 bool Package::extract_in_parallel = true;
+ThreadPool *Package::thread_pool = nullptr;
+JobServer *Package::job_server = nullptr;
+std::function<void(Package *)> Package::staging_released_hook;
+BuildHistory *Package::build_history = nullptr;
 std::string Package::build_cache;
+BuildCache *Package::cache_client = nullptr;
+CacheUploader *Package::cache_uploader = nullptr;
 bool Package::clean_all_packages = false;
 std::list<std::string> Package::overlays = {"."};
 std::list<std::string> Package::forced_packages;
@@ -71,6 +78,68 @@ void Package::set_extract_in_parallel(bool set)
 	extract_in_parallel = set;
 }
 
+/**
+ * Set the pool of threads used for extracting in parallel.
+ *
+ * @param pool - The pool to use (nullptr to extract on the building thread).
+ */
+void Package::set_thread_pool(ThreadPool *pool)
+{
+	thread_pool = pool;
+}
+
+/**
+ * Set the jobserver shared by package builds and the make they run.
+ *
+ * @param js - The jobserver (nullptr if no job budget is set).
+ */
+void Package::set_job_server(JobServer *js)
+{
+	job_server = js;
+}
+
+/**
+ * Set the function to call when a package has released its staging output.
+ *
+ * @param hook - The function to call.
+ */
+void Package::set_staging_released_hook(std::function<void(Package *)> hook)
+{
+	staging_released_hook = std::move(hook);
+}
+
+/**
+ * Set the history that runs of packages are recorded in, and scheduled from.
+ *
+ * @param history - The build history.
+ */
+void Package::set_build_history(BuildHistory *history)
+{
+	build_history = history;
+}
+
+/**
+ * Set the client used to fetch from the build cache. Without one, files are fetched
+ * from the build cache one at a time with wget.
+ *
+ * @param client - The build cache client.
+ */
+void Package::set_cache_client(BuildCache *client)
+{
+	cache_client = client;
+}
+
+/**
+ * Set where to queue the outputs of built packages, to be uploaded to the build cache.
+ * Without one, nothing is uploaded.
+ *
+ * @param uploader - The build cache uploader.
+ */
+void Package::set_cache_uploader(CacheUploader *uploader)
+{
+	cache_uploader = uploader;
+}
+
 /**
  *  Set the location of the build output cache
  *
@@ -81,6 +150,16 @@ void Package::set_build_cache(std::string cache)
 	build_cache = std::move(cache);
 }
 
+/**
+ *  Get the location of the build output cache
+ *
+ *  @returns The location, empty if there is no build cache.
+ */
+const std::string &Package::get_build_cache()
+{
+	return build_cache;
+}
+
 /**
  * Configure all packages to clean before building.
  *
@@ -292,13 +371,15 @@ void Package::printLabel(std::ostream &out)
 	out << this->getName() << "\\n";
 	out << this->getNS()->getName() << "\\n";
 	out << "Cmds:" << this->commands.size() << "\\n";
-	out << "Time: " << this->run_secs << "s";
+	out << "Time: " << this->run_secs << "s\\n";
+	out << "Parse: " << this->process_time.count() / 1000 << "ms";
 
 	out << "\"]";
 }
 
 bool Package::process()
 {
+	steady_clock::time_point start = steady_clock::now();
 	this->log(boost::format{"Processing (%1%)"} % this->file);
 
 	this->build_description.add_package_file(this->file_short, hash_file(this->file));
@@ -312,6 +393,9 @@ bool Package::process()
 
 	this->lua.processFile(this->file);
 
+	steady_clock::time_point end = steady_clock::now();
+	this->process_time = duration_cast<std::chrono::microseconds>(end - start);
+
 	return true;
 }
 
@@ -324,6 +408,10 @@ bool Package::process()
  */
 bool Package::extract_staging(const std::string &dir)
 {
+	if(!this->fetchDeferredArtifacts()) {
+		return false;
+	}
+
 	PackageCmd pc(dir, TAR_CMD);
 	pc.addArg("--no-same-owner");
 	pc.addArg("-b");
@@ -350,6 +438,10 @@ bool Package::extract_staging(const std::string &dir)
  */
 bool Package::extract_install(const std::string &dir)
 {
+	if(!this->fetchDeferredArtifacts()) {
+		return false;
+	}
+
 	if(!this->installFiles.empty()) {
 		for(const auto &install_file : this->installFiles) {
 			PackageCmd pc(dir, "cp");
@@ -381,21 +473,6 @@ bool Package::extract_install(const std::string &dir)
 	return true;
 }
 
-bool Package::canBuild()
-{
-	if(this->isBuilt()) {
-		return true;
-	}
-
-	for(auto &dp : this->depends) {
-		if(!dp.getPackage()->isBuilt()) {
-			return false;
-		}
-	}
-
-	return true;
-}
-
 bool Package::ff_file(const std::string &hash, const std::string &rfile,
                       const std::string &path, const std::string &fname,
                       const std::string &fext)
@@ -441,6 +518,57 @@ Package::BuildInfoType Package::buildInfo(std::string *file_path, std::string *h
 	return BuildInfoType::Build;
 }
 
+/**
+ * Get the time taken to build this package, as recorded by the last invocation
+ * that built it.
+ *
+ * @param secs - Set to the recorded build time in seconds.
+ *
+ * @returns true if a build time was recorded, false otherwise.
+ */
+bool Package::getPreviousBuildTime(time_t *secs) const
+{
+	BuildHistory::Record record;
+	std::string key = this->ns->getName() + "/" + this->name;
+	if(Package::build_history == nullptr ||
+	   !Package::build_history->lastBuild(key, &record)) {
+		return false;
+	}
+	*secs = record.total_ms / 1000;
+	return true;
+}
+
+/**
+ * Record a run of this package in the build history, if one is kept.
+ *
+ * @param record - The timings and usage gathered so far.
+ * @param start - When the run started.
+ * @param outcome - What the run did ("built", "cached", "current" or "failed").
+ */
+void Package::recordRun(BuildHistory::Record *record, steady_clock::time_point start,
+                        const std::string &outcome)
+{
+	if(Package::build_history == nullptr) {
+		return;
+	}
+
+	std::string key = this->ns->getName() + "/" + this->name;
+	record->hash = this->buildinfo_hash;
+	record->outcome = outcome;
+	record->total_ms = duration_cast<milliseconds>(steady_clock::now() - start).count();
+
+	// Point out builds that have become much slower
+	BuildHistory::Record previous;
+	if(outcome == "built" && Package::build_history->lastBuild(key, &previous) &&
+	   record->total_ms > 2 * previous.total_ms &&
+	   record->total_ms - previous.total_ms > 60000) {
+		this->log(boost::format{"Build took %1%s, up from %2%s last time"} %
+		          (record->total_ms / 1000) % (previous.total_ms / 1000));
+	}
+
+	Package::build_history->record(key, *record);
+}
+
 void Package::prepareBuildInfo()
 {
 	if(this->buildInfoPrepared) {
@@ -460,10 +588,8 @@ void Package::prepareBuildInfo()
 		auto type = dp.getPackage()->buildInfo(&file_path, &hash);
 
 		if(hash.empty()) {
-			this->log(boost::format{"build info for %1% is empty"} %
-			          dp.getPackage()->getName());
-			this->log("You probably need to build that package");
-			exit(-1);
+			throw CustomException("build info for " + dp.getPackage()->getName() +
+			                      " is empty, you probably need to build that package");
 		}
 
 		if(type == BuildInfoType::Output) {
@@ -491,42 +617,95 @@ void Package::updateBuildInfo(bool updateOutputHash)
 
 	if(updateOutputHash && this->isHashingOutput()) {
 		// Hash the entire new path
-		auto cmd = boost::format{"cd %1%; find -type f -exec sha256sum {} \\; | sort -k 2 "
-		                         "> %2%/.output.info"} %
-		           this->bd.getNewPath() % this->bd.getPath();
-		std::system(cmd.str().c_str());
+		std::ofstream output_info(this->bd.getPath() + "/.output.info");
+		if(!hash_tree(this->bd.getNewPath(), Package::thread_pool, output_info)) {
+			this->log("Failed to hash every output file");
+		}
 	}
 }
 
-bool Package::fetchFrom()
+/**
+ * Fetch files stored for this package in the build cache.
+ *
+ * @param files - For each file, the name in the cache, the directory to put it in, and
+ *                the name (and extension) to give it.
+ *
+ * @returns true if they could not be fetched, false if they were.
+ */
+bool Package::fetchFromCache(const std::vector<std::array<std::string, 4>> &files)
+{
+	if(Package::cache_client == nullptr) {
+		for(auto &element : files) {
+			if(this->ff_file(this->buildinfo_hash, element.at(0), element.at(1),
+			                 element.at(2), element.at(3))) {
+				return true;
+			}
+		}
+		return false;
+	}
+
+	std::vector<BuildCache::Download> downloads;
+	for(auto &element : files) {
+		downloads.push_back(
+		    {element.at(0), element.at(1) + "/" + element.at(2) + element.at(3)});
+	}
+	std::string key =
+	    this->getNS()->getName() + "/" + this->name + "/" + this->buildinfo_hash;
+	std::string error;
+	if(!Package::cache_client->fetch(key, downloads, &error)) {
+		this->log("Failed to get from the build cache: " + error);
+		return true;
+	}
+	return false;
+}
+
+/**
+ * Get the output archives of this package from the build cache.
+ *
+ * @returns true if they could not be fetched, false if they were.
+ */
+bool Package::fetchArtifacts()
 {
-	bool ret = false;
 	std::string staging_dir = this->getNS()->getStagingDir();
 	std::string install_dir = this->getNS()->getInstallDir();
-	std::vector<std::array<std::string, 4>> files = {
+	return this->fetchFromCache({
 	    {"usable", staging_dir, this->name, ".tar.ff"},
 	    {"staging.tar", staging_dir, this->name, ".tar"},
 	    {"install.tar", install_dir, this->name, ".tar"},
-	    {"output.info", this->bd.getPath(), ".output", ".info"},
-	};
+	});
+}
+
+bool Package::fetchFrom()
+{
+	bool ret = false;
 
 	this->log(boost::format{"FF URL: %1%/%2%/%3%/%4%"} % Package::build_cache %
 	          this->getNS()->getName() % this->name % this->buildinfo_hash);
 
-	if(!this->isHashingOutput()) {
-		files.pop_back();
+	if(!this->defer_artifacts) {
+		ret = this->fetchArtifacts();
 	}
-
-	for(auto &element : files) {
-		ret = this->ff_file(this->buildinfo_hash, element.at(0), element.at(1),
-		                    element.at(2), element.at(3));
-		if(ret) {
-			break;
-		}
+	if(!ret && this->isHashingOutput()) {
+		ret = this->fetchFromCache(
+		    {{"output.info", this->bd.getPath(), ".output", ".info"}});
 	}
 
 	if(ret) {
 		this->log("Could not optimize away building");
+	} else if(this->defer_artifacts) {
+		this->log("Build cache used (outputs are only fetched if needed)");
+		// Old outputs must not be taken as current next time
+		std::string staging_tar =
+		    this->pwd + "/" + this->getNS()->getStagingDir() + "/" + this->name + ".tar";
+		filesystem::remove(staging_tar);
+		filesystem::remove(staging_tar + ".ff");
+		filesystem::remove(this->pwd + "/" + this->getNS()->getInstallDir() + "/" +
+		                   this->name + ".tar");
+		{
+			std::unique_lock<std::mutex> lk(this->artifacts_lock);
+			this->artifacts_deferred = true;
+		}
+		this->updateBuildInfo(false);
 	} else {
 		this->log("Build cache used");
 
@@ -536,6 +715,52 @@ bool Package::fetchFrom()
 	return ret;
 }
 
+/**
+ * Fetch the output archives that were left in the build cache, now that a package
+ * being built needs them.
+ *
+ * @returns true if the archives are present, false otherwise.
+ */
+bool Package::fetchDeferredArtifacts()
+{
+	std::unique_lock<std::mutex> lk(this->artifacts_lock);
+	if(!this->artifacts_deferred) {
+		return true;
+	}
+	this->log("Fetching outputs from the build cache");
+	if(this->fetchArtifacts()) {
+		this->log("Fetching outputs from the build cache failed");
+		return false;
+	}
+	this->artifacts_deferred = false;
+	return true;
+}
+
+/**
+ * Queue our new outputs to be uploaded to the build cache, if they are being uploaded.
+ */
+void Package::uploadToCache()
+{
+	// Packages that install files are always rebuilt, so are never fetched
+	if(Package::cache_uploader == nullptr || !this->installFiles.empty()) {
+		return;
+	}
+
+	std::string output = this->pwd + "/output/" + this->getNS()->getName();
+	std::vector<BuildCache::Upload> uploads = {
+	    {"staging.tar", output + "/staging/" + this->name + ".tar"},
+	    {"install.tar", output + "/install/" + this->name + ".tar"},
+	};
+	if(this->isHashingOutput()) {
+		uploads.push_back({"output.info", this->bd.getPath() + "/.output.info"});
+	}
+	std::string key =
+	    this->getNS()->getName() + "/" + this->name + "/" + this->buildinfo_hash;
+	if(!Package::cache_uploader->add(key, std::move(uploads))) {
+		this->log("Build cache upload queue is full, not uploading");
+	}
+}
+
 bool Package::shouldBuild()
 {
 	// we need to rebuild if the code is updated
@@ -572,8 +797,13 @@ bool Package::shouldBuild()
 	// if there are changes,
 	if(res != 0 || ret) {
 		// see if we can grab new staging/install files
-		if(!Package::build_cache.empty()) {
+		if(this->cache_availability == BuildCache::Availability::Miss) {
+			// The cache was asked before building, and doesn't have them
+			this->log("Not in the build cache");
+			ret = true;
+		} else if(!Package::build_cache.empty()) {
 			ret = this->fetchFrom();
+			this->fetched_from_cache = !ret;
 		} else {
 			// otherwise, make sure we get (re)built
 			ret = true;
@@ -612,6 +842,24 @@ void Package::getDependedPackages(std::unordered_set<Package *> *packages,
 	}
 }
 
+/**
+ * Get the set of packages whose install output is extracted when building this package.
+ *
+ * @param The set to fill with the packages.
+ */
+void Package::getInstallPackages(std::unordered_set<Package *> *packages)
+{
+	if(this->depsExtraction.empty()) {
+		return;
+	}
+	if(this->closures_set && !this->depsExtractionDirectOnly) {
+		this->depended_closure.for_each(
+		    [packages](size_t pid) { packages->insert(NameSpace::packageById(pid)); });
+		return;
+	}
+	this->getDependedPackages(packages, !this->depsExtractionDirectOnly, false);
+}
+
 /**
  * Get the set of packages required to populate the staging directory
  *
@@ -619,6 +867,12 @@ void Package::getDependedPackages(std::unordered_set<Package *> *packages,
  */
 void Package::getStagingPackages(std::unordered_set<Package *> *packages)
 {
+	if(this->closures_set) {
+		this->staging_closure.for_each(
+		    [packages](size_t pid) { packages->insert(NameSpace::packageById(pid)); });
+		return;
+	}
+
 	for(auto &dp : this->depends) {
 		// This depended package is already in the set, don't add it again.
 		if(packages->find(dp.getPackage()) != packages->end()) {
@@ -655,17 +909,16 @@ bool Package::prepareBuildDirs()
 	std::unordered_set<Package *> packages;
 	this->getStagingPackages(&packages);
 
-	std::list<std::thread> threads;
+	TaskGroup group(Package::thread_pool);
 	std::atomic<bool> result{true};
 	for(auto p : packages) {
 		if(Package::extract_in_parallel) {
-			std::thread th([p, this, &result] {
+			group.run([p, this, &result] {
 				bool ret = p->extract_staging(this->bd.getStaging());
 				if(!ret) {
 					result = false;
 				}
 			});
-			threads.push_back(std::move(th));
 		} else {
 			result = p->extract_staging(this->bd.getStaging());
 			if(!result) {
@@ -673,9 +926,7 @@ bool Package::prepareBuildDirs()
 			}
 		}
 	}
-	for(auto &t : threads) {
-		t.join();
-	}
+	group.wait();
 
 	if(result) {
 		this->log(boost::format{"Done (%1%)"} % packages.size());
@@ -707,19 +958,18 @@ bool Package::extractInstallDepends()
 	this->log("Extracting installed files from dependencies ...");
 
 	std::unordered_set<Package *> packages;
-	this->getDependedPackages(&packages, !this->depsExtractionDirectOnly, false);
+	this->getInstallPackages(&packages);
 
-	std::list<std::thread> threads;
+	TaskGroup group(Package::thread_pool);
 	std::atomic<bool> result{true};
 	for(auto p : packages) {
 		if(Package::extract_in_parallel) {
-			std::thread th([p, this, &result] {
+			group.run([p, this, &result] {
 				bool ret = p->extract_install(this->depsExtraction);
 				if(!ret) {
 					result = false;
 				}
 			});
-			threads.push_back(std::move(th));
 		} else {
 			result = p->extract_install(this->depsExtraction);
 			if(!result) {
@@ -727,9 +977,7 @@ bool Package::extractInstallDepends()
 			}
 		}
 	}
-	for(auto &t : threads) {
-		t.join();
-	}
+	group.wait();
 
 	if(result) {
 		this->log("Dependency install files extracted");
@@ -813,110 +1061,265 @@ bool Package::should_suppress_building()
 	return (this->is_forced_mode() && !is_forced);
 }
 
-bool Package::build(bool locally)
+/**
+ * Clean the build directory (if requested) and create the new extraction info.
+ * The caller must hold the sources lock.
+ */
+void Package::describeSources()
 {
-	// Hold the lock for the whole build, to avoid multiple running at once
-	std::unique_lock<std::mutex> lk(this->lock);
+	if(this->sources_described) {
+		return;
+	}
 
-	// Already build, pretend to successfully build
-	if((locally && this->was_built) || (!locally && this->isBuilt())) {
+	if(this->clean_before_build) {
+		this->log("Cleaning");
+		this->bd.clean();
+	}
+
+	// Create the new extraction.info file
+	this->Extract.prepareNewExtractInfo(this, &this->bd);
+	this->sources_described = true;
+}
+
+/**
+ * Fetch anything we don't have yet, and extract the sources if they have changed.
+ *
+ * @returns true if successful, false otherwise.
+ */
+bool Package::prepareSources()
+{
+	std::unique_lock<std::mutex> lk(this->sources_lock);
+
+	this->describeSources();
+	if(this->sources_prepared) {
 		return true;
 	}
 
-	/* Check our dependencies are already built, or build them */
+	if(!this->fetch()->fetch(&this->bd)) {
+		this->log("Fetching failed");
+		return false;
+	}
+
+	if(this->Extract.extractionRequired(this, &this->bd)) {
+		this->log("Extracting ...");
+		if(!this->Extract.extract(this)) {
+			return false;
+		}
+	}
+
+	this->sources_prepared = true;
+	return true;
+}
+
+void Package::prefetchSources()
+{
+	// When the build cache may provide this package the sources might never be needed
+	bool may_be_cached = !Package::build_cache.empty() &&
+	                     this->cache_availability != BuildCache::Availability::Miss;
+	if(this->should_suppress_building() || may_be_cached) {
+		return;
+	}
+
+	// Only downloads, nothing is extracted into work/ or cleaned before the build.
+	// Files already in dl/ are left as they are.
+	try {
+		std::unique_lock<std::mutex> lk(this->sources_lock);
+		if(!this->fetch()->download(&this->bd)) {
+			this->log("Downloading ahead failed, will retry when building");
+		}
+	} catch(std::exception &e) {
+		this->log(boost::format{"Downloading ahead failed (%1%), will retry when building"} %
+		          e.what());
+	}
+}
+
+/**
+ * Work out the build info hash ahead of building, so that everything that needs the
+ * hashes (e.g. cache lookups) can be done for the whole graph up front. This is only
+ * possible when what we record about each dependency is already known, which is not
+ * the case for dependencies that hash their output until they have been built. Those
+ * packages, and the packages above them, are left for build() to work out.
+ *
+ * @returns true if the hash is known, false otherwise.
+ */
+bool Package::prepareBuildInfoAhead()
+{
+	std::unique_lock<std::mutex> lk(this->lock);
+
+	if(this->should_suppress_building()) {
+		// Nothing gets built, so what is present is final
+		this->updateBuildInfoHashExisting();
+		this->build_info_final = !this->buildinfo_hash.empty();
+		return this->build_info_final;
+	}
+
 	for(auto &dp : this->depends) {
-		if(!dp.getPackage()->build()) {
+		if(!dp.getPackage()->build_info_final) {
 			return false;
 		}
 	}
 
+	try {
+		{
+			std::unique_lock<std::mutex> sources_lk(this->sources_lock);
+			this->describeSources();
+		}
+		this->prepareBuildInfo();
+	} catch(std::exception &e) {
+		this->log(boost::format{"Build info not known ahead (%1%)"} % e.what());
+		return false;
+	}
+	this->build_info_final = !this->isHashingOutput();
+	return true;
+}
+
+Package::BuildResult Package::build(bool locally)
+{
+	// Hold the lock for the whole build, to avoid multiple running at once. Only our
+	// own lock is taken, the scheduler has already built the dependencies.
+	std::unique_lock<std::mutex> lk(this->lock);
+
+	// Already build, pretend to successfully build
+	if((locally && this->was_built) || (!locally && this->isBuilt())) {
+		return BuildResult::Built;
+	}
+
 	if(this->should_suppress_building()) {
 		// Set the build.info hash based on what is currently present
 		this->updateBuildInfoHashExisting();
 		this->log("Building suppressed");
-		// Just pretend we are built
+		// Just pretend we are built, and that there is nothing to rebuild locally
 		this->built = true;
-		return true;
+		this->was_built = true;
+		return BuildResult::Built;
 	}
 
-	if(this->clean_before_build) {
-		this->log("Cleaning");
-		this->bd.clean();
+	{
+		std::unique_lock<std::mutex> sources_lk(this->sources_lock);
+		this->describeSources();
 	}
 
-	// Create the new extraction.info file
-	this->Extract.prepareNewExtractInfo(this, &this->bd);
-
 	// Create the new build.info file
-	this->prepareBuildInfo();
+	try {
+		this->prepareBuildInfo();
+	} catch(CustomException &e) {
+		this->log(e.what());
+		return BuildResult::Failed;
+	}
 
-	// Check if building is required
-	if(!locally && !this->shouldBuild()) {
-		this->log("Not required");
-		// Already built
-		this->built = true;
-		return true;
+	BuildHistory::Record record;
+	record.started = time(nullptr);
+	steady_clock::time_point start = steady_clock::now();
+
+	// Check if building is required (only once, when resuming after local rebuilds
+	// the answer is already known)
+	if(!locally && !this->needs_build) {
+		if(!this->shouldBuild()) {
+			this->log("Not required");
+			this->recordRun(&record, start,
+			                this->fetched_from_cache ? "cached" : "current");
+			// Already built
+			this->built = true;
+			return BuildResult::Built;
+		}
+		this->needs_build = true;
 	}
-	// Need to check that any packages that need to have been built locally
-	// actually have been
+	// Any packages that need to have been built locally must have been, otherwise
+	// the scheduler rebuilds them and builds us again
+	bool needs_local = false;
 	for(auto &dp : this->depends) {
-		if(dp.getLocally()) {
+		if(dp.getLocally() && !dp.getPackage()->wasBuilt()) {
 			dp.getPackage()->log("Build triggered by " + this->getName());
-			if(!dp.getPackage()->build(true)) {
-				return false;
-			}
+			needs_local = true;
 		}
 	}
-
-	// Fetch anything we don't have yet
-	if(!this->fetch()->fetch(&this->bd)) {
-		this->log("Fetching failed");
-		return false;
+	if(needs_local) {
+		return BuildResult::NeedsLocal;
 	}
 
-	steady_clock::time_point start = steady_clock::now();
+	// Only a package that really builds holds a jobserver token, which also serves as
+	// the implicit job slot of any make it runs
+	JobToken token(Package::job_server);
+
+	start = steady_clock::now();
+	steady_clock::time_point stage_start = start;
+	auto stage_ms = [&stage_start]() {
+		steady_clock::time_point now = steady_clock::now();
+		int64_t ms = duration_cast<milliseconds>(now - stage_start).count();
+		stage_start = now;
+		return ms;
+	};
 
-	if(this->Extract.extractionRequired(this, &this->bd)) {
-		this->log("Extracting ...");
-		if(!this->Extract.extract(this)) {
-			return false;
-		}
+	// Fetch and extract (downloads may already have been done ahead of the build)
+	if(!this->prepareSources()) {
+		this->recordRun(&record, start, "failed");
+		return BuildResult::Failed;
 	}
+	record.fetch_ms = stage_ms();
 
 	this->log("Building ...");
 	// Clean new/{staging,install}, Extract the dependency staging directories
-	if(!this->prepareBuildDirs()) {
-		return false;
-	}
-
-	if(!this->extractInstallDepends()) {
-		return false;
+	if(!this->prepareBuildDirs() || !this->extractInstallDepends()) {
+		this->recordRun(&record, start, "failed");
+		return BuildResult::Failed;
 	}
+	record.prepare_ms = stage_ms();
 
 	auto cIt = this->commands.begin();
 	auto cEnd = this->commands.end();
 
 	this->log("Running Commands");
 	for(; cIt != cEnd; cIt++) {
-		if(!(*cIt).Run(&this->logger)) {
-			return false;
+		// Only the commands from the package file are connected to the jobserver (on
+		// a copy, the commands are run again by a local rebuild)
+		PackageCmd cmd = *cIt;
+		if(Package::job_server != nullptr) {
+			cmd.addMakeFlags(Package::job_server->makeFlags());
+			cmd.inheritFd(Package::job_server->getReadFd());
+			cmd.inheritFd(Package::job_server->getWriteFd());
+		}
+		bool ran = cmd.Run(&this->logger);
+
+		const rusage &usage = cmd.getUsage();
+		record.cpu_ms += (usage.ru_utime.tv_sec + usage.ru_stime.tv_sec) * 1000 +
+		                 (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) / 1000;
+		record.peak_rss_kb = std::max<int64_t>(record.peak_rss_kb, usage.ru_maxrss);
+		// Blocks are counted in 512 byte units
+		record.bytes_written += static_cast<int64_t>(usage.ru_oublock) * 512;
+
+		if(!ran) {
+			this->recordRun(&record, start, "failed");
+			return BuildResult::Failed;
 		}
 	}
 	this->log("Done Commands");
+	record.commands_ms = stage_ms();
 
 	this->log("BUILT");
 
 	if(!this->packageNewStaging()) {
-		return false;
+		this->recordRun(&record, start, "failed");
+		return BuildResult::Failed;
+	}
+
+	this->updateBuildInfo();
+
+	// Dependents that only need the staging output can start building now
+	if(!this->staging_released.exchange(true) && Package::staging_released_hook) {
+		Package::staging_released_hook(this);
 	}
 
 	if(!this->packageNewInstall()) {
-		return false;
+		// The build info is already updated, make sure we get rebuilt next time
+		filesystem::remove(this->bd.getPath() + "/.build.info");
+		this->recordRun(&record, start, "failed");
+		return BuildResult::Failed;
 	}
 
 	this->cleanStaging();
-
-	this->updateBuildInfo();
+	record.package_ms = stage_ms();
+	this->recordRun(&record, start, "built");
+	this->uploadToCache();
 
 	steady_clock::time_point end = steady_clock::now();
 
@@ -928,5 +1331,5 @@ bool Package::build(bool locally)
 	this->was_built = true;
 	lk.unlock();
 
-	return true;
+	return BuildResult::Built;
 }
@@ -26,6 +26,7 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include "packagecmd.hpp"
 #include "include/buildsys.h"
 #include <algorithm>
+#include <fcntl.h>
 #include <pty.h>
 #include <string>
 #include <utility>
@@ -48,6 +49,35 @@ PackageCmd::PackageCmd(std::string _path, std::string _app)
 	}
 }
 
+/**
+ * Add flags to the MAKEFLAGS of this command, after any it inherited.
+ * Used to connect make to the jobserver.
+ *
+ * @param flags - The flags to add.
+ */
+void PackageCmd::addMakeFlags(const std::string &flags)
+{
+	auto existing =
+	    std::find_if(this->envp.begin(), this->envp.end(), [](const std::string &env) {
+		    return env.compare(0, 10, "MAKEFLAGS=") == 0;
+	    });
+	if(existing != this->envp.end()) {
+		existing->append(" " + flags);
+	} else {
+		this->envp.push_back("MAKEFLAGS=" + flags);
+	}
+}
+
+/**
+ * Keep a close-on-exec file descriptor open in this command.
+ *
+ * @param fd - The file descriptor.
+ */
+void PackageCmd::inheritFd(int fd)
+{
+	this->inherit_fds.push_back(fd);
+}
+
 /**
  * The thread for printing the output of the command executed
  * via fork + exec.
@@ -134,6 +164,11 @@ int PackageCmd::exec_process(Logger *logger, int *fd)
 			close(pipe_fds.at(1));
 		}
 
+		// Descriptors we were asked to pass on (e.g. the jobserver pipe)
+		for(auto inherit : this->inherit_fds) {
+			fcntl(inherit, F_SETFD, 0);
+		}
+
 		if(chdir(this->path.c_str()) != 0) {
 			logger->log(boost::format{"chdir '%1%' failed"} % this->path);
 			exit(-1);
@@ -182,12 +217,12 @@ bool PackageCmd::Run(Logger *logger)
 		int pid = this->exec_process(logger, &fd);
 
 		std::thread thr(pipe_data_thread, logger, fd);
-		waitpid(pid, &status, 0);
+		wait4(pid, &status, 0, &this->usage);
 		thr.join();
 		close(fd);
 	} else {
 		int pid = this->exec_process(logger, nullptr);
-		waitpid(pid, &status, 0);
+		wait4(pid, &status, 0, &this->usage);
 	}
 
 	// check return status ...
@@ -291,3 +326,14 @@ bool PackageCmd::getLogOutput() const
 {
 	return this->log_output;
 }
+
+/**
+ * Get the resources used by the last run of this command, including any processes it
+ * waited for.
+ *
+ * @returns The resource usage.
+ */
+const rusage &PackageCmd::getUsage() const
+{
+	return this->usage;
+}
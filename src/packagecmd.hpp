@@ -28,6 +28,7 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 #include <logger.hpp>
 #include <string>
+#include <sys/resource.h>
 #include <vector>
 
 namespace buildsys
@@ -40,6 +41,8 @@ namespace buildsys
 		std::vector<std::string> args;
 		std::vector<std::string> envp;
 		bool log_output{true};
+		rusage usage{};
+		std::vector<int> inherit_fds;
 
 		int exec_process(Logger *logger, int *fd);
 
@@ -47,6 +50,8 @@ namespace buildsys
 		PackageCmd(std::string _path, std::string _app);
 		void addArg(const std::string &arg);
 		void addEnv(const std::string &env);
+		void addMakeFlags(const std::string &flags);
+		void inheritFd(int fd);
 		bool Run(Logger *logger);
 		void printCmd(Logger *logger) const;
 		void disableLogging();
@@ -55,6 +60,7 @@ namespace buildsys
 		const std::vector<std::string> &getArgs() const;
 		const std::vector<std::string> &getEnvp() const;
 		bool getLogOutput() const;
+		const rusage &getUsage() const;
 	};
 } // namespace buildsys
 
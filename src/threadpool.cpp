@@ -0,0 +1,283 @@
+/******************************************************************************
+ Copyright 2026 Allied Telesis Labs Ltd. All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+    1. Redistributions of source code must retain the above copyright notice,
+       this list of conditions and the following disclaimer.
+
+    2. Redistributions in binary form must reproduce the above copyright
+       notice, this list of conditions and the following disclaimer in the
+       documentation and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*******************************************************************************/
+
+#include "threadpool.hpp"
+#include <algorithm>
+
+using namespace buildsys;
+using std::chrono::duration_cast;
+using std::chrono::steady_clock;
+
+//! The queue owned by the current thread, if it is a worker
+static thread_local size_t worker_queue = 0;
+//! The pool the current thread is a worker of
+static thread_local const ThreadPool *worker_pool = nullptr;
+
+/**
+ * Construct the ThreadPool and start the worker threads.
+ *
+ * @param threads - The number of worker threads (at least 1 is started).
+ */
+ThreadPool::ThreadPool(size_t threads)
+{
+	threads = std::max<size_t>(threads, 1);
+	for(size_t i = 0; i < threads; i++) {
+		this->queues.push_back(std::make_unique<WorkQueue>());
+	}
+	for(size_t i = 0; i < threads; i++) {
+		this->workers.emplace_back(&ThreadPool::worker, this, i);
+	}
+}
+
+/**
+ * Stop the worker threads once they have finished their current task.
+ * Tasks that have not yet started are discarded.
+ */
+ThreadPool::~ThreadPool()
+{
+	{
+		std::unique_lock<std::mutex> lk(this->lock);
+		this->stopping = true;
+	}
+	this->cond.notify_all();
+	for(auto &worker : this->workers) {
+		worker.join();
+	}
+}
+
+/**
+ * Queue a task to be run. Tasks submitted from a worker go on that worker's queue,
+ * other tasks are spread across the queues.
+ *
+ * @param func - The task to run.
+ */
+void ThreadPool::submit(std::function<void()> func)
+{
+	size_t index = (worker_pool == this) ? worker_queue
+	                                     : (this->next_queue++ % this->queues.size());
+	WorkQueue &queue = *this->queues[index];
+	{
+		std::unique_lock<std::mutex> lk(queue.lock);
+		queue.tasks.push_back({std::move(func), steady_clock::now()});
+	}
+	{
+		std::unique_lock<std::mutex> lk(this->lock);
+		size_t depth = ++this->queued;
+		if(depth > this->max_queued) {
+			this->max_queued = depth;
+		}
+	}
+	this->cond.notify_one();
+}
+
+/**
+ * Take a task, trying the given queue first (newest task) and then stealing from
+ * the other queues (oldest task).
+ *
+ * @param index - The queue to try first.
+ * @param task - Set to the task taken.
+ *
+ * @returns true if a task was taken, false if all the queues are empty.
+ */
+bool ThreadPool::take(size_t index, Task *task)
+{
+	size_t count = this->queues.size();
+	for(size_t i = 0; i < count; i++) {
+		WorkQueue &queue = *this->queues[(index + i) % count];
+		std::unique_lock<std::mutex> lk(queue.lock);
+		if(queue.tasks.empty()) {
+			continue;
+		}
+		if(i == 0) {
+			*task = std::move(queue.tasks.back());
+			queue.tasks.pop_back();
+		} else {
+			*task = std::move(queue.tasks.front());
+			queue.tasks.pop_front();
+		}
+		this->queued--;
+		return true;
+	}
+	return false;
+}
+
+/**
+ * Run a task, recording how long it waited in the queue.
+ *
+ * @param task - The task to run.
+ */
+void ThreadPool::run(Task *task)
+{
+	auto waited = steady_clock::now() - task->queued;
+	this->total_wait_us += duration_cast<std::chrono::microseconds>(waited).count();
+	this->tasks_run++;
+	task->func();
+}
+
+/**
+ * The worker thread main loop.
+ *
+ * @param index - The index of the queue owned by this worker.
+ */
+void ThreadPool::worker(size_t index)
+{
+	worker_queue = index;
+	worker_pool = this;
+
+	while(!this->stopping) {
+		Task task;
+		if(this->take(index, &task)) {
+			this->run(&task);
+			continue;
+		}
+		std::unique_lock<std::mutex> lk(this->lock);
+		this->cond.wait(lk, [this] { return this->stopping || this->queued != 0; });
+	}
+}
+
+/**
+ * Get the number of worker threads.
+ */
+size_t ThreadPool::size() const
+{
+	return this->workers.size();
+}
+
+/**
+ * Get the number of tasks waiting to be run.
+ */
+size_t ThreadPool::queueDepth() const
+{
+	return this->queued;
+}
+
+/**
+ * Get the largest number of tasks that have been waiting to be run at once.
+ */
+size_t ThreadPool::maxQueueDepth() const
+{
+	return this->max_queued;
+}
+
+/**
+ * Get the number of tasks that have been run.
+ */
+size_t ThreadPool::tasksRun() const
+{
+	return this->tasks_run;
+}
+
+/**
+ * Get the total time tasks have spent waiting to be run.
+ */
+std::chrono::microseconds ThreadPool::totalWait() const
+{
+	return std::chrono::microseconds(this->total_wait_us);
+}
+
+/**
+ * Take the oldest queued task of a group and run it. An exception thrown by the
+ * task is kept to be rethrown by wait(), the task is counted as finished either way.
+ *
+ * @param state - The group state.
+ *
+ * @returns true if a task was run, false if the group had no queued tasks.
+ */
+bool TaskGroup::runNext(const std::shared_ptr<State> &state)
+{
+	std::function<void()> func;
+	{
+		std::unique_lock<std::mutex> lk(state->lock);
+		if(state->tasks.empty()) {
+			return false;
+		}
+		func = std::move(state->tasks.front());
+		state->tasks.pop_front();
+	}
+
+	std::exception_ptr error;
+	try {
+		func();
+	} catch(...) {
+		error = std::current_exception();
+	}
+
+	std::unique_lock<std::mutex> lk(state->lock);
+	if(error && !state->error) {
+		state->error = error;
+	}
+	state->pending--;
+	state->cond.notify_all();
+	return true;
+}
+
+/**
+ * Run a task as part of this group. Without a pool, the task is run immediately.
+ *
+ * @param func - The task to run.
+ */
+void TaskGroup::run(std::function<void()> func)
+{
+	if(this->pool == nullptr) {
+		func();
+		return;
+	}
+
+	{
+		std::unique_lock<std::mutex> lk(this->state->lock);
+		this->state->tasks.push_back(std::move(func));
+		this->state->pending++;
+	}
+	this->state->cond.notify_all();
+	// The waiting thread may get to the task first, in which case this does nothing
+	this->pool->submit([state = this->state] { TaskGroup::runNext(state); });
+}
+
+/**
+ * Wait for all the tasks in this group to finish, running the group's queued tasks
+ * meanwhile. If any task threw, the first exception is rethrown once they are done.
+ */
+void TaskGroup::wait()
+{
+	while(true) {
+		while(TaskGroup::runNext(this->state)) {
+		}
+
+		// Wait for tasks running elsewhere, which may add more work to the group
+		std::unique_lock<std::mutex> lk(this->state->lock);
+		this->state->cond.wait(lk, [this] {
+			return this->state->pending == 0 || !this->state->tasks.empty();
+		});
+		if(this->state->pending != 0) {
+			continue;
+		}
+		if(this->state->error) {
+			std::exception_ptr error = this->state->error;
+			this->state->error = nullptr;
+			std::rethrow_exception(error);
+		}
+		return;
+	}
+}
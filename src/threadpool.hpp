@@ -0,0 +1,119 @@
+/******************************************************************************
+ Copyright 2026 Allied Telesis Labs Ltd. All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+    1. Redistributions of source code must retain the above copyright notice,
+       this list of conditions and the following disclaimer.
+
+    2. Redistributions in binary form must reproduce the above copyright
+       notice, this list of conditions and the following disclaimer in the
+       documentation and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*******************************************************************************/
+
+#ifndef THREADPOOL_HPP_
+#define THREADPOOL_HPP_
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace buildsys
+{
+	/**
+	 * A fixed size pool of worker threads. Each worker has its own queue of tasks,
+	 * and takes work from the other queues once its own is empty.
+	 */
+	class ThreadPool
+	{
+	private:
+		struct Task {
+			std::function<void()> func;
+			std::chrono::steady_clock::time_point queued;
+		};
+		struct WorkQueue {
+			std::mutex lock;
+			std::deque<Task> tasks;
+		};
+		std::vector<std::unique_ptr<WorkQueue>> queues;
+		std::vector<std::thread> workers;
+		std::mutex lock;
+		std::condition_variable cond;
+		std::atomic<bool> stopping{false};
+		std::atomic<size_t> queued{0};
+		std::atomic<size_t> next_queue{0};
+		std::atomic<size_t> max_queued{0};
+		std::atomic<size_t> tasks_run{0};
+		std::atomic<int64_t> total_wait_us{0};
+
+		bool take(size_t index, Task *task);
+		void run(Task *task);
+		void worker(size_t index);
+
+	public:
+		explicit ThreadPool(size_t threads);
+		~ThreadPool();
+		ThreadPool(const ThreadPool &) = delete;
+		ThreadPool &operator=(const ThreadPool &) = delete;
+		ThreadPool(ThreadPool &&) = delete;
+		ThreadPool &operator=(ThreadPool &&) = delete;
+		void submit(std::function<void()> func);
+		size_t size() const;
+		size_t queueDepth() const;
+		size_t maxQueueDepth() const;
+		size_t tasksRun() const;
+		std::chrono::microseconds totalWait() const;
+	};
+
+	/**
+	 * A group of tasks run on a ThreadPool that can be waited for together.
+	 * The group keeps its own queue of tasks, which the pool workers and the
+	 * waiting thread both take from. Waiting only ever runs this group's tasks,
+	 * so a task may wait for tasks it has started without tying up a worker, and
+	 * without picking up unrelated work from the pool.
+	 */
+	class TaskGroup
+	{
+	private:
+		struct State {
+			std::mutex lock;
+			std::condition_variable cond;
+			std::deque<std::function<void()>> tasks;
+			size_t pending{0};
+			std::exception_ptr error;
+		};
+		ThreadPool *pool;
+		std::shared_ptr<State> state;
+
+		static bool runNext(const std::shared_ptr<State> &state);
+
+	public:
+		explicit TaskGroup(ThreadPool *_pool)
+		    : pool(_pool), state(std::make_shared<State>())
+		{
+		}
+		void run(std::function<void()> func);
+		void wait();
+	};
+} // namespace buildsys
+
+#endif // THREADPOOL_HPP_
@@ -24,67 +24,128 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 *******************************************************************************/
 
 #include "include/buildsys.h"
+#include <fstream>
+#include <unistd.h>
 
-static void build_thread(World *w, Package *p)
+using std::chrono::duration_cast;
+using std::chrono::steady_clock;
+
+//! The most built packages to have waiting to be uploaded to the build cache
+static const size_t upload_queue_size = 256;
+
+static void build_thread(World *w, Package *p, bool locally)
 {
 	p->log("Build Thread");
 	p->log(boost::format{"Building (%1% others running)"} % (w->threadsRunning() - 1));
 
 	try {
-		if(p->build()) {
-			w->packageFinished(p);
+		Package::BuildResult result = p->build(locally);
+		if(result == Package::BuildResult::Built) {
+			if(locally) {
+				w->packageLocallyBuilt(p);
+			} else {
+				w->packageFinished(p);
+			}
+		} else if(result == Package::BuildResult::NeedsLocal && !locally) {
+			w->packageNeedsLocalBuilds(p);
 		} else {
 			w->setFailed(p);
 			p->log("Building failed");
 		}
 	} catch(std::exception &e) {
+		// Nothing above the pool worker can handle this, let the build loop see it
 		p->log(e.what());
-		throw;
+		w->setFailed(p);
+		p->log("Building failed");
 	}
-	w->threadEnded();
+	w->threadEnded(p);
 
 	p->log(boost::format{"Finished (%1% others running)"} % w->threadsRunning());
 }
 
-static void process_package(Package *p, PackageQueue *pq)
+static void process_package(World *w, Package *p, TaskGroup *group)
 {
 	try {
 		if(!p->process()) {
 			p->log("Processing failed");
 		}
 	} catch(std::exception &e) {
+		// Includes dependency loops. Stop following this package, basePackage()
+		// reports the failure
 		p->log(e.what());
-		throw;
+		w->setFailed(p);
+		return;
 	}
 
 	for(auto &depend : p->getDepends()) {
 		Package *dp = depend.getPackage();
 		if(dp->setProcessingQueued()) {
-			pq->push(dp);
+			group->run([w, dp, group] { process_package(w, dp, group); });
 		}
 	}
-
-	pq->finish();
 }
 
-static void process_packages(Package *p)
+static void process_packages(World *w, Package *p, ThreadPool *pool)
 {
-	PackageQueue pq;
-	pq.push(p);
+	steady_clock::time_point start = steady_clock::now();
+	TaskGroup group(pool);
 
-	while(!pq.done()) {
-		Package *toProcess = pq.pop();
-		if(toProcess != nullptr) {
-			pq.start();
+	p->setProcessingQueued();
+	group.run([w, p, &group] { process_package(w, p, &group); });
+	group.wait();
 
-			std::thread thr(process_package, toProcess, &pq);
-			thr.detach();
-		}
-		pq.wait();
+	auto wall = duration_cast<std::chrono::milliseconds>(steady_clock::now() - start);
+
+	// Report the overall parse time, and the packages that took the longest
+	std::vector<Package *> packages;
+	std::chrono::microseconds total{0};
+	NameSpace::for_each([&packages, &total](const NameSpace &ns) {
+		ns.for_each_package([&packages, &total](Package &package) {
+			packages.push_back(&package);
+			total += package.getProcessTime();
+		});
+	});
+	auto slowest = std::min<size_t>(packages.size(), 5);
+	std::partial_sort(packages.begin(), packages.begin() + static_cast<ptrdiff_t>(slowest),
+	                  packages.end(), [](const Package *a, const Package *b) {
+		                  return a->getProcessTime() > b->getProcessTime();
+	                  });
+
+	Logger logger("BuildSys");
+	logger.log(boost::format{"Processed %1% packages in %2%ms (%3%ms parsing, %4% "
+	                         "threads)"} %
+	           packages.size() % wall.count() % (total.count() / 1000) % pool->size());
+	for(size_t i = 0; i < slowest; i++) {
+		logger.log(boost::format{"    %1%,%2%: %3%ms"} % packages[i]->getNS()->getName() %
+		           packages[i]->getName() % (packages[i]->getProcessTime().count() / 1000));
 	}
 }
 
 bool World::basePackage(const std::string &filename)
+{
+	bool ret = this->buildBasePackage(filename);
+	this->stopPools();
+	return ret;
+}
+
+/**
+ * Stop the thread pools, so nothing is left running on them once basePackage()
+ * returns. Queued tasks are dropped, packages that are still building are waited for.
+ */
+void World::stopPools()
+{
+	if(this->threadsRunning() > 0) {
+		Logger("BuildSys").log(boost::format{"Waiting for %1% packages still building"} %
+		                       this->threadsRunning());
+	}
+	this->fetch_pool.reset();
+	this->pool.reset();
+	Package::set_thread_pool(nullptr);
+	Package::set_staging_released_hook(nullptr);
+	Package::set_job_server(nullptr);
+}
+
+bool World::buildBasePackage(const std::string &filename)
 {
 	Logger err_logger("BuildSys");
 
@@ -99,19 +160,29 @@ bool World::basePackage(const std::string &filename)
 	Package *base_package = p.get();
 	ns->addPackage(std::move(p));
 
-	process_packages(base_package);
+	// Bound the number of threads, but allow for every package the limit lets build
+	int most_running =
+	    (this->admission) ? this->admission->getMaxLimit() : this->threads_limit;
+	size_t pool_size = std::max<size_t>(std::thread::hardware_concurrency(),
+	                                    static_cast<size_t>(most_running));
+	this->pool = std::make_unique<ThreadPool>(pool_size);
+	Package::set_thread_pool(this->pool.get());
+	Package::set_staging_released_hook(
+	    [this](Package *released) { this->packageStagingReleased(released); });
+
+	process_packages(this, base_package, this->pool.get());
+	if(this->isFailed()) {
+		// Each package that failed (e.g. closed a dependency loop) has logged why
+		err_logger.log("Processing failed");
+		return false;
+	}
 
 	this->topo_graph.fill();
 
-	std::unordered_set<Package *> cycled_packages = this->topo_graph.get_cycled_packages();
-	if(!cycled_packages.empty()) {
-		err_logger.log("Dependency Loop Detected");
-		err_logger.log("Cycled Packages:");
-		for(auto &package : cycled_packages) {
-			err_logger.log(boost::format{"    %1%,%2%"} % package->getNS()->getName() %
-			               package->getName());
-		}
-		return false;
+	this->topo_graph.computeClosures();
+
+	if(this->hasQueries()) {
+		return this->runQueries();
 	}
 
 	if(this->areParseOnly()) {
@@ -119,23 +190,90 @@ bool World::basePackage(const std::string &filename)
 		return true;
 	}
 
-	this->topo_graph.topological();
+	// Work out the build info hashes for the whole graph before building anything
+	steady_clock::time_point hash_start = steady_clock::now();
+	std::atomic<size_t> hashes_known{0};
+	this->topo_graph.forEachInOrder(this->pool.get(), [&hashes_known](Package *package) {
+		if(package->prepareBuildInfoAhead()) {
+			hashes_known++;
+		}
+	});
+	auto hash_ms =
+	    duration_cast<std::chrono::milliseconds>(steady_clock::now() - hash_start).count();
+	err_logger.log(boost::format{"Build info: %1% of %2% hashes known ahead (%3%ms)"} %
+	               hashes_known % NameSpace::packageCount() % hash_ms);
+
+	if(!Package::get_build_cache().empty()) {
+		this->probeBuildCache();
+		if(this->lazy_cache && this->cache && !Package::is_forced_mode()) {
+			this->deferCacheArtifacts(base_package);
+		}
+		if(this->cache_upload) {
+			this->startCacheUploads();
+		}
+	}
+
+	// Downloading doesn't depend on other packages, so start it now on its own
+	// threads, leaving the main pool free for building
+	size_t fetch_pool_size = std::max<size_t>(std::thread::hardware_concurrency() / 2, 1);
+	this->fetch_pool = std::make_unique<ThreadPool>(fetch_pool_size);
+	NameSpace::for_each([this](const NameSpace &each_ns) {
+		each_ns.for_each_package([this](Package &package) {
+			Package *fetching = &package;
+			this->fetch_pool->submit([fetching] { fetching->prefetchSources(); });
+		});
+	});
+
+	// Load the timings of previous runs, used to schedule the longest paths first
+	filesystem::create_directories("output");
+	this->history = std::make_unique<BuildHistory>("output/history.db");
+	this->history->load();
+	Package::set_build_history(this->history.get());
+
+	// Record every change made to the package limit, so it can be audited later
+	std::unique_ptr<Logger> admission_logger;
+	if(this->admission) {
+		admission_logger = std::make_unique<Logger>("Admission", "output/admission.log");
+		this->admission->setLogger(admission_logger.get());
+	}
+
+	// Fit packages into the cores and memory of the host, or the job budget if given
+	if(this->capacity_cores == 0) {
+		int cores = static_cast<int>(std::max(std::thread::hardware_concurrency(), 1U));
+		if(this->jobserver) {
+			cores = this->jobserver->getTokens();
+		}
+		uint64_t memory = static_cast<uint64_t>(sysconf(_SC_PHYS_PAGES)) *
+		                  static_cast<uint64_t>(sysconf(_SC_PAGE_SIZE)) / (1024 * 1024);
+		this->setCapacity(cores, memory);
+	}
+
+	this->topo_graph.prepareSchedule();
 	while(!this->isFailed() && !base_package->isBuilt()) {
 		std::unique_lock<std::mutex> lk(this->cond_lock);
+		int limit = this->threads_limit;
+		if(this->admission) {
+			limit = this->admission->update(steady_clock::now());
+		}
 		Package *toBuild = nullptr;
-		if(this->threads_limit == 0 || this->threads_running < this->threads_limit) {
-			toBuild = this->topo_graph.topoNext();
+		bool locally = false;
+		if(limit == 0 || this->threads_running < limit) {
+			// Local rebuilds first, packages part way through building wait on them
+			toBuild = this->topo_graph.localNext();
+			locally = (toBuild != nullptr);
+			if(toBuild == nullptr) {
+				toBuild = this->topo_graph.topoNext(
+				    [this](Package *ready) { return this->packageFits(ready); });
+			}
 		}
 		if(toBuild != nullptr) {
-			// If this package is already building then skip it.
-			if(toBuild->isBuilding()) {
-				continue;
-			}
-
 			toBuild->setBuilding();
-			this->threadStarted();
-			std::thread thr(build_thread, this, toBuild);
-			thr.detach();
+			this->threadStarted(toBuild);
+			this->pool->submit(
+			    [this, toBuild, locally] { build_thread(this, toBuild, locally); });
+		} else if(this->admission) {
+			// Wake up to sample the host again, the limit may have changed
+			this->cond.wait_for(lk, AdmissionControl::interval);
 		} else {
 			this->cond.wait(lk);
 		}
@@ -153,14 +291,290 @@ bool World::basePackage(const std::string &filename)
 			}
 		}
 	}
+
+	this->finishCacheUploads();
+
+	auto tasks = static_cast<int64_t>(this->pool->tasksRun());
+	auto wait_ms = (tasks != 0) ? (this->pool->totalWait().count() / tasks / 1000) : 0;
+	err_logger.log(boost::format{"Thread pool: %1% threads, %2% tasks, peak queue depth "
+	                             "%3%, average wait %4%ms"} %
+	               this->pool->size() % tasks % this->pool->maxQueueDepth() % wait_ms);
+	if(this->admission) {
+		err_logger.log(boost::format{"Package limit: finished at %1%, raised %2% times, "
+		                             "lowered %3% times"} %
+		               this->admission->getLimit() % this->admission->getRaised() %
+		               this->admission->getLowered());
+		this->admission->setLogger(nullptr);
+	}
+
 	return !this->failed;
 }
 
+/**
+ * Quote a string for a JSON document.
+ *
+ * @param str - The string.
+ *
+ * @returns The quoted string.
+ */
+static std::string json_string(const std::string &str)
+{
+	std::string quoted = "\"";
+	for(char c : str) {
+		if(c == '"' || c == '\\') {
+			quoted += '\\';
+			quoted += c;
+		} else if(static_cast<unsigned char>(c) < 0x20) {
+			quoted += (boost::format{"\\u%04x"} % static_cast<int>(c)).str();
+		} else {
+			quoted += c;
+		}
+	}
+	return quoted + "\"";
+}
+
+/**
+ * Write the names of some packages out as a sorted JSON array.
+ *
+ * @param out - The stream to write to.
+ * @param packages - The packages.
+ */
+static void json_packages(std::ostream &out, const std::vector<Package *> &packages)
+{
+	std::vector<std::string> names;
+	names.reserve(packages.size());
+	for(auto p : packages) {
+		names.push_back(p->getNS()->getName() + "," + p->getName());
+	}
+	std::sort(names.begin(), names.end());
+	out << "[";
+	for(size_t i = 0; i < names.size(); i++) {
+		out << ((i == 0) ? "" : ",") << json_string(names[i]);
+	}
+	out << "]";
+}
+
+/**
+ * Answer the queries over the parsed packages, writing one JSON object per query (one
+ * per line) to output/query.jsonl. Each object lists the packages directly affected
+ * ("direct": the package itself, or the packages that read the feature) and every
+ * package that would need rebuilding as a result ("packages").
+ *
+ * @returns true if every query could be answered, false otherwise.
+ */
+bool World::runQueries()
+{
+	steady_clock::time_point start = steady_clock::now();
+	Logger logger("BuildSys");
+
+	std::map<std::string, Package *> by_name;
+	std::map<std::string, std::vector<Package *>> by_feature;
+	size_t count = NameSpace::packageCount();
+	for(size_t id = 0; id < count; id++) {
+		Package *p = NameSpace::packageById(id);
+		by_name[p->getNS()->getName() + "," + p->getName()] = p;
+		for(auto &feature : p->buildDescription()->getFeatures()) {
+			auto &users = by_feature[feature];
+			if(users.empty() || users.back() != p) {
+				users.push_back(p);
+			}
+		}
+	}
+
+	filesystem::create_directories("output");
+	std::ofstream out("output/query.jsonl");
+	for(auto &query : this->queries) {
+		std::vector<Package *> direct;
+		if(query.first == "rdeps") {
+			auto it = by_name.find(query.second);
+			if(it == by_name.end()) {
+				logger.log("Query: No package " + query.second);
+				return false;
+			}
+			direct.push_back(it->second);
+		} else {
+			auto it = by_feature.find(query.second);
+			if(it != by_feature.end()) {
+				direct = it->second;
+			}
+		}
+
+		std::vector<Package *> affected;
+		this->topo_graph.dependentClosure(direct).for_each(
+		    [&affected](size_t id) { affected.push_back(NameSpace::packageById(id)); });
+
+		out << "{\"query\":" << json_string(query.first)
+		    << ",\"subject\":" << json_string(query.second) << ",\"direct\":";
+		json_packages(out, direct);
+		out << ",\"packages\":";
+		json_packages(out, affected);
+		out << "}" << std::endl;
+		logger.log(boost::format{"Query: %1% %2%: %3% packages affected"} % query.first %
+		           query.second % affected.size());
+	}
+
+	auto taken = duration_cast<std::chrono::milliseconds>(steady_clock::now() - start);
+	logger.log(boost::format{"Answered %1% queries in %2%ms, see output/query.jsonl"} %
+	           this->queries.size() % taken.count());
+	return true;
+}
+
+/**
+ * Ask the build cache about every package whose build info hash is known, all at once,
+ * so that only the packages it has are fetched from it, and the rest are built
+ * without asking again.
+ */
+void World::probeBuildCache()
+{
+	Logger logger("BuildSys");
+	if(!BuildCache::supported(Package::get_build_cache())) {
+		logger.log("Build cache: Can only ask http:// caches ahead, asking as packages "
+		           "build instead");
+		return;
+	}
+	steady_clock::time_point start = steady_clock::now();
+	this->cache = std::make_unique<BuildCache>(Package::get_build_cache(),
+	                                           this->cache_connections);
+	Package::set_cache_client(this->cache.get());
+
+	std::vector<Package *> packages;
+	std::vector<std::string> keys;
+	size_t count = NameSpace::packageCount();
+	for(size_t id = 0; id < count; id++) {
+		Package *p = NameSpace::packageById(id);
+		if(!p->getBuildInfoHash().empty()) {
+			packages.push_back(p);
+			keys.push_back(p->getNS()->getName() + "/" + p->getName() + "/" +
+			               p->getBuildInfoHash());
+		}
+	}
+
+	std::vector<BuildCache::Availability> results = this->cache->probe(keys);
+	size_t hits = 0;
+	size_t misses = 0;
+	for(size_t i = 0; i < packages.size(); i++) {
+		packages[i]->setCacheAvailability(results[i]);
+		if(results[i] == BuildCache::Availability::Hit) {
+			hits++;
+		} else if(results[i] == BuildCache::Availability::Miss) {
+			misses++;
+		}
+	}
+
+	auto taken = duration_cast<std::chrono::milliseconds>(steady_clock::now() - start);
+	logger.log(boost::format{"Build cache: %1% hits, %2% misses, %3% unknown (%4%ms)"} %
+	           hits % misses % (packages.size() - hits - misses) % taken.count());
+}
+
+/**
+ * Choose the cached packages whose output archives can be left in the build cache.
+ * The archives of a package are needed when a package that is not cached extracts
+ * them, or when the package was asked for (it is depended on by the base package, or
+ * nothing depends on it). Others are only fetched if a package unexpectedly has to be
+ * built after all.
+ *
+ * @param base - The base package.
+ */
+void World::deferCacheArtifacts(Package *base)
+{
+	IdSet needed;
+	IdSet depended;
+	size_t count = NameSpace::packageCount();
+	for(size_t id = 0; id < count; id++) {
+		Package *p = NameSpace::packageById(id);
+		if(p->getCacheAvailability() != BuildCache::Availability::Hit) {
+			needed.unite(p->getStagingClosure());
+			needed.unite(p->getDependedClosure());
+		}
+		for(auto &dp : p->getDepends()) {
+			depended.insert(dp.getPackage()->getId());
+			if(p == base) {
+				needed.insert(dp.getPackage()->getId());
+			}
+		}
+	}
+
+	size_t deferred = 0;
+	for(size_t id = 0; id < count; id++) {
+		Package *p = NameSpace::packageById(id);
+		if(p->getCacheAvailability() == BuildCache::Availability::Hit &&
+		   !needed.contains(id) && depended.contains(id)) {
+			p->setDeferArtifacts(true);
+			deferred++;
+		}
+	}
+
+	Logger logger("BuildSys");
+	logger.log(boost::format{"Build cache: Only fetching metadata for %1% packages"} %
+	           deferred);
+}
+
+/**
+ * Start uploading the outputs of the packages that get built to the build cache.
+ */
+void World::startCacheUploads()
+{
+	if(!this->cache) {
+		Logger logger("BuildSys");
+		logger.log("Build cache: Can only upload to http:// caches, not uploading");
+		return;
+	}
+	// Most of the connections are left for fetching from the cache
+	size_t threads = std::max<size_t>(this->cache_connections / 4, 1);
+	this->uploader =
+	    std::make_unique<CacheUploader>(this->cache.get(), threads, upload_queue_size);
+	Package::set_cache_uploader(this->uploader.get());
+}
+
+/**
+ * Wait for the uploads to the build cache to be done, once everything is built.
+ */
+void World::finishCacheUploads()
+{
+	if(!this->uploader) {
+		return;
+	}
+	Package::set_cache_uploader(nullptr);
+	steady_clock::time_point start = steady_clock::now();
+	this->uploader->finish();
+
+	auto taken = duration_cast<std::chrono::milliseconds>(steady_clock::now() - start);
+	Logger logger("BuildSys");
+	logger.log(boost::format{"Build cache: %1% packages uploaded, %2% failed, %3% not "
+	                         "queued (waited %4%ms)"} %
+	           this->uploader->getUploaded() % this->uploader->getFailed() %
+	           this->uploader->getDropped() % taken.count());
+	this->uploader.reset();
+}
+
 bool World::packageFinished(Package *_p)
 {
 	std::unique_lock<std::mutex> lk(this->cond_lock);
-	this->topo_graph.deleteNode(_p);
-	this->topo_graph.topological();
+	this->topo_graph.packageBuilt(_p);
+	_p->log(boost::format{"Progress: %1%/%2% packages, about %3%s remaining"} %
+	        this->topo_graph.builtCount() % this->topo_graph.size() %
+	        this->topo_graph.remainingTime());
 	this->cond.notify_all();
 	return true;
 }
+
+void World::packageNeedsLocalBuilds(Package *_p)
+{
+	std::unique_lock<std::mutex> lk(this->cond_lock);
+	this->topo_graph.packageNeedsLocalBuilds(_p);
+	this->cond.notify_all();
+}
+
+void World::packageLocallyBuilt(Package *_p)
+{
+	std::unique_lock<std::mutex> lk(this->cond_lock);
+	this->topo_graph.packageLocallyBuilt(_p);
+	this->cond.notify_all();
+}
+
+void World::packageStagingReleased(Package *_p)
+{
+	std::unique_lock<std::mutex> lk(this->cond_lock);
+	this->topo_graph.packageStagingReleased(_p);
+	this->cond.notify_all();
+}
@@ -0,0 +1,101 @@
+#define CATCH_CONFIG_MAIN
+
+#include "admission.hpp"
+#include "exceptions.hpp"
+#include <catch2/catch.hpp>
+#include <filesystem>
+#include <fstream>
+
+using namespace buildsys;
+using std::chrono::steady_clock;
+namespace filesystem = std::filesystem;
+
+class AdmissionTestsFixture
+{
+protected:
+	std::string proc{"admission_proc"};
+
+public:
+	AdmissionTestsFixture()
+	{
+		filesystem::create_directories(this->proc + "/pressure");
+	}
+	~AdmissionTestsFixture()
+	{
+		filesystem::remove_all(this->proc);
+	}
+
+	void set_host(double memory_some, double memory_full, double loadavg)
+	{
+		std::ofstream memory(this->proc + "/pressure/memory");
+		memory << "some avg10=" << memory_some << " avg60=0.00 avg300=0.00 total=0\n";
+		memory << "full avg10=" << memory_full << " avg60=0.00 avg300=0.00 total=0\n";
+		std::ofstream load(this->proc + "/loadavg");
+		load << loadavg << " 0.00 0.00 1/100 1234\n";
+	}
+};
+
+TEST_CASE("Test AdmissionControl requires valid bounds", "")
+{
+	REQUIRE_THROWS_AS(AdmissionControl(0, 4), CustomException);
+	REQUIRE_THROWS_AS(AdmissionControl(4, 2), CustomException);
+}
+
+TEST_CASE_METHOD(AdmissionTestsFixture, "Test AdmissionControl reads pressure", "")
+{
+	this->set_host(12.5, 0.75, 3.25);
+	AdmissionControl ac(1, 4, this->proc);
+
+	AdmissionControl::Sample s = ac.sample();
+	REQUIRE(s.memory_some == 12.5);
+	REQUIRE(s.memory_full == 0.75);
+	REQUIRE(s.cpu_some == 0);
+	REQUIRE(s.loadavg == 3.25);
+}
+
+TEST_CASE_METHOD(AdmissionTestsFixture, "Test AdmissionControl ignores garbled pressure", "")
+{
+	this->set_host(0, 0, 1.0);
+	std::ofstream(this->proc + "/pressure/memory") << "some avg10=\nfull avg10=1.5x\n";
+	std::ofstream(this->proc + "/pressure/cpu") << "some avg10=abc";
+	AdmissionControl ac(1, 4, this->proc);
+
+	AdmissionControl::Sample s = ac.sample();
+	REQUIRE(s.memory_some == 0);
+	REQUIRE(s.memory_full == 0);
+	REQUIRE(s.cpu_some == 0);
+	REQUIRE(s.loadavg == 1.0);
+}
+
+TEST_CASE_METHOD(AdmissionTestsFixture, "Test AdmissionControl adjusts within bounds", "")
+{
+	AdmissionControl ac(2, 4, this->proc);
+	auto now = steady_clock::now();
+	REQUIRE(ac.getLimit() == 2);
+
+	// An idle host lets the limit rise to the upper bound, one sample at a time
+	this->set_host(0, 0, 0);
+	REQUIRE(ac.update(now) == 3);
+	REQUIRE(ac.update(now) == 3);
+	now += AdmissionControl::interval;
+	REQUIRE(ac.update(now) == 4);
+	now += AdmissionControl::interval;
+	REQUIRE(ac.update(now) == 4);
+	REQUIRE(ac.getRaised() == 2);
+
+	// Memory pressure lowers it, down to the lower bound
+	this->set_host(50, 0, 0);
+	now += AdmissionControl::interval;
+	REQUIRE(ac.update(now) == 3);
+	this->set_host(50, 10, 0);
+	now += AdmissionControl::interval;
+	REQUIRE(ac.update(now) == 2);
+	now += AdmissionControl::interval;
+	REQUIRE(ac.update(now) == 2);
+	REQUIRE(ac.getLowered() == 2);
+
+	// An overloaded cpu holds it down
+	this->set_host(0, 0, 100000);
+	now += AdmissionControl::interval;
+	REQUIRE(ac.update(now) == 2);
+}
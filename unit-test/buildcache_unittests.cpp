@@ -0,0 +1,425 @@
+#define CATCH_CONFIG_MAIN
+
+#include "buildcache.hpp"
+#include "hash.hpp"
+#include <arpa/inet.h>
+#include <atomic>
+#include <catch2/catch.hpp>
+#include <filesystem>
+#include <fstream>
+#include <map>
+#include <mutex>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <thread>
+#include <unistd.h>
+
+using namespace buildsys;
+namespace filesystem = std::filesystem;
+
+//! A local stand-in for the cache server, serving files from memory
+class LocalServer
+{
+private:
+	int listen_fd{-1};
+	std::thread acceptor;
+	std::vector<std::thread> handlers;
+	std::vector<int> client_fds;
+	std::mutex lock;
+
+	void handle(int fd)
+	{
+		std::string buffer;
+		char data[4096];
+		while(true) {
+			size_t end = buffer.find("\r\n\r\n");
+			if(end == std::string::npos) {
+				ssize_t res = recv(fd, data, sizeof(data), 0);
+				if(res <= 0) {
+					return;
+				}
+				buffer.append(data, static_cast<size_t>(res));
+				continue;
+			}
+			std::string request = buffer.substr(0, end);
+			buffer.erase(0, end + 4);
+			this->requests++;
+
+			std::string method = request.substr(0, request.find(' '));
+			size_t path_start = method.size() + 1;
+			std::string path =
+			    request.substr(path_start, request.find(' ', path_start) - path_start);
+
+			// Only the Content-Length header is understood for request bodies
+			size_t length = 0;
+			size_t header = request.find("Content-Length: ");
+			if(header != std::string::npos) {
+				length = std::stoul(request.substr(header + 16));
+			}
+			while(buffer.size() < length) {
+				ssize_t res = recv(fd, data, sizeof(data), 0);
+				if(res <= 0) {
+					return;
+				}
+				buffer.append(data, static_cast<size_t>(res));
+			}
+			std::string content = buffer.substr(0, length);
+			buffer.erase(0, length);
+
+			std::string response;
+			std::string body;
+			{
+				std::unique_lock<std::mutex> lk(this->lock);
+				auto it = this->files.find(path);
+				if(this->failures[path] > 0) {
+					this->failures[path]--;
+					response = "HTTP/1.1 503 Unavailable\r\nContent-Length: 0\r\n\r\n";
+				} else if(method == "PUT") {
+					this->files[path] = content;
+					this->stored.push_back(path);
+					response = "HTTP/1.1 201 Created\r\nContent-Length: 0\r\n\r\n";
+				} else if(it == this->files.end()) {
+					response = "HTTP/1.1 404 Not Found\r\nContent-Length: 0\r\n\r\n";
+				} else if(this->chunked) {
+					response = "HTTP/1.1 200 OK\r\nTransfer-Encoding: chunked\r\n\r\n";
+					if(method != "HEAD") {
+						for(char c : it->second) {
+							body += "1\r\n" + std::string(1, c) + "\r\n";
+						}
+						body += "0\r\n\r\n";
+					}
+				} else {
+					response = "HTTP/1.1 200 OK\r\nContent-Length: " +
+					           std::to_string(it->second.size()) + "\r\n\r\n";
+					if(method != "HEAD") {
+						body = it->second;
+					}
+				}
+			}
+			response += body;
+			if(send(fd, response.data(), response.size(), MSG_NOSIGNAL) < 0) {
+				return;
+			}
+		}
+	}
+
+public:
+	std::map<std::string, std::string> files;
+	//! How many times to fail requests for a path before answering them
+	std::map<std::string, int> failures;
+	//! The paths stored to, in order
+	std::vector<std::string> stored;
+	bool chunked{false};
+	std::atomic<int> connections{0};
+	std::atomic<int> requests{0};
+	int port{0};
+
+	LocalServer()
+	{
+		this->listen_fd = socket(AF_INET, SOCK_STREAM, 0);
+		sockaddr_in addr{};
+		addr.sin_family = AF_INET;
+		addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+		bind(this->listen_fd, reinterpret_cast<sockaddr *>(&addr), sizeof(addr));
+		socklen_t len = sizeof(addr);
+		getsockname(this->listen_fd, reinterpret_cast<sockaddr *>(&addr), &len);
+		this->port = ntohs(addr.sin_port);
+		listen(this->listen_fd, 64);
+
+		this->acceptor = std::thread([this] {
+			while(true) {
+				int fd = accept(this->listen_fd, nullptr, nullptr);
+				if(fd < 0) {
+					return;
+				}
+				this->connections++;
+				std::unique_lock<std::mutex> lk(this->lock);
+				this->client_fds.push_back(fd);
+				this->handlers.emplace_back([this, fd] { this->handle(fd); });
+			}
+		});
+	}
+	~LocalServer()
+	{
+		shutdown(this->listen_fd, SHUT_RDWR);
+		close(this->listen_fd);
+		this->acceptor.join();
+		for(auto fd : this->client_fds) {
+			shutdown(fd, SHUT_RDWR);
+		}
+		for(auto &handler : this->handlers) {
+			handler.join();
+		}
+		for(auto fd : this->client_fds) {
+			close(fd);
+		}
+	}
+	std::string url() const
+	{
+		return "http://127.0.0.1:" + std::to_string(this->port) + "/cache";
+	}
+};
+
+TEST_CASE("Test HttpUrl parse() function", "")
+{
+	HttpUrl url;
+	REQUIRE(HttpUrl::parse("http://cache.example:8080/builds/", &url));
+	REQUIRE(url.host == "cache.example");
+	REQUIRE(url.port == "8080");
+	REQUIRE(url.path == "/builds");
+
+	REQUIRE(HttpUrl::parse("http://cache.example", &url));
+	REQUIRE(url.host == "cache.example");
+	REQUIRE(url.port == "80");
+	REQUIRE(url.path.empty());
+
+	REQUIRE(HttpUrl::parse("http://[::1]:81/x", &url));
+	REQUIRE(url.host == "::1");
+	REQUIRE(url.port == "81");
+
+	REQUIRE(!HttpUrl::parse("https://cache.example/builds", &url));
+	REQUIRE(!HttpUrl::parse("/local/cache", &url));
+	REQUIRE(!BuildCache::supported("ftp://cache.example"));
+}
+
+TEST_CASE("Test HttpConnection reuses its connection", "")
+{
+	LocalServer server;
+	server.files["/a"] = "hello";
+	server.files["/b"] = "world";
+
+	HttpConnection connection("127.0.0.1", std::to_string(server.port));
+	std::string body;
+	auto sink = [&body](const char *data, size_t length) {
+		body.append(data, length);
+		return true;
+	};
+	REQUIRE(connection.request("GET", "/a", sink) == 200);
+	REQUIRE(connection.request("HEAD", "/b", sink) == 200);
+	REQUIRE(connection.request("GET", "/missing", sink) == 404);
+	REQUIRE(connection.request("GET", "/b", sink) == 200);
+	REQUIRE(body == "helloworld");
+	REQUIRE(server.connections == 1);
+	REQUIRE(server.requests == 4);
+}
+
+TEST_CASE("Test HttpConnection reads chunked responses", "")
+{
+	LocalServer server;
+	server.files["/a"] = "chunks";
+	server.chunked = true;
+
+	HttpConnection connection("127.0.0.1", std::to_string(server.port));
+	std::string body;
+	auto sink = [&body](const char *data, size_t length) {
+		body.append(data, length);
+		return true;
+	};
+	REQUIRE(connection.request("GET", "/a", sink) == 200);
+	REQUIRE(connection.request("GET", "/a", sink) == 200);
+	REQUIRE(body == "chunkschunks");
+	REQUIRE(server.connections == 1);
+}
+
+TEST_CASE("Test HttpConnection fails without a server", "")
+{
+	int port = 0;
+	{
+		LocalServer server;
+		port = server.port;
+	}
+	HttpConnection connection("127.0.0.1", std::to_string(port));
+	REQUIRE(connection.request("GET", "/a") == -1);
+}
+
+TEST_CASE("Test BuildCache probe() function", "")
+{
+	LocalServer server;
+	std::vector<std::string> keys;
+	for(int i = 0; i < 50; i++) {
+		keys.push_back("ns/p" + std::to_string(i) + "/hash" + std::to_string(i));
+		if(i % 3 == 0) {
+			server.files["/cache/" + keys.back() + "/usable"] = "";
+		}
+	}
+
+	BuildCache cache(server.url(), 4);
+	std::vector<BuildCache::Availability> results = cache.probe(keys);
+	REQUIRE(results.size() == keys.size());
+	for(size_t i = 0; i < keys.size(); i++) {
+		REQUIRE(results[i] == ((i % 3 == 0) ? BuildCache::Availability::Hit
+		                                    : BuildCache::Availability::Miss));
+	}
+	REQUIRE(server.connections <= 4);
+	REQUIRE(cache.probe({}).empty());
+}
+
+static std::string read_file(const std::string &path)
+{
+	std::ifstream in(path);
+	return std::string(std::istreambuf_iterator<char>(in), {});
+}
+
+static void write_file(const std::string &path, const std::string &data)
+{
+	std::ofstream out(path);
+	out << data;
+}
+
+static std::string sha256(const std::string &data)
+{
+	Hasher hasher;
+	hasher.update(data.data(), data.size());
+	return hasher.finish();
+}
+
+TEST_CASE("Test BuildCache fetch() function", "")
+{
+	LocalServer server;
+	filesystem::create_directories("buildcache_test");
+	std::string dir = "/cache/ns/p/h1/";
+	server.files[dir + "staging.tar"] = "staging data";
+	server.files[dir + "install.tar"] = "install data";
+	server.files[dir + "SHA256SUMS"] = sha256("staging data") + "  staging.tar\n" +
+	                                   sha256("install data") + " *install.tar\n";
+
+	BuildCache cache(server.url(), 2);
+	std::string error;
+
+	SECTION("Files are downloaded and checked")
+	{
+		REQUIRE(cache.fetch("ns/p/h1",
+		                    {{"staging.tar", "buildcache_test/staging.tar"},
+		                     {"install.tar", "buildcache_test/install.tar"}},
+		                    &error));
+		REQUIRE(read_file("buildcache_test/staging.tar") == "staging data");
+		REQUIRE(read_file("buildcache_test/install.tar") == "install data");
+		REQUIRE(server.connections <= 2);
+	}
+
+	SECTION("Failed requests are tried again")
+	{
+		server.failures[dir + "SHA256SUMS"] = 1;
+		server.failures[dir + "staging.tar"] = BuildCache::attempts - 1;
+		REQUIRE(cache.fetch("ns/p/h1", {{"staging.tar", "buildcache_test/staging.tar"}},
+		                    &error));
+		REQUIRE(read_file("buildcache_test/staging.tar") == "staging data");
+	}
+
+	SECTION("Corrupt files are not kept")
+	{
+		server.files[dir + "install.tar"] = "corrupt data";
+		REQUIRE(!cache.fetch("ns/p/h1", {{"install.tar", "buildcache_test/install.tar"}},
+		                     &error));
+		REQUIRE(error == "install.tar: Digest mismatch");
+		REQUIRE(!filesystem::exists("buildcache_test/install.tar"));
+		REQUIRE(!filesystem::exists("buildcache_test/install.tar.part"));
+	}
+
+	SECTION("Missing files fail without trying again")
+	{
+		REQUIRE(!cache.fetch("ns/p/h1", {{"usable", "buildcache_test/usable"}}, &error));
+		REQUIRE(error == "usable: HTTP 404");
+		REQUIRE(server.requests == 2);
+	}
+
+	SECTION("Files without digests are still fetched")
+	{
+		server.files.erase(dir + "SHA256SUMS");
+		server.files[dir + "install.tar"] = "other data";
+		REQUIRE(cache.fetch("ns/p/h1", {{"install.tar", "buildcache_test/install.tar"}},
+		                    &error));
+		REQUIRE(read_file("buildcache_test/install.tar") == "other data");
+	}
+
+	filesystem::remove_all("buildcache_test");
+}
+
+TEST_CASE("Test HttpConnection sends request bodies", "")
+{
+	LocalServer server;
+	HttpConnection connection("127.0.0.1", std::to_string(server.port));
+	std::string data(200 * 1024, 'x');
+	auto source = [&data](size_t offset, char *out, size_t length) {
+		return data.copy(out, length, offset);
+	};
+	REQUIRE(connection.request("PUT", "/a", nullptr, source, data.size()) == 201);
+	REQUIRE(connection.request("PUT", "/b", nullptr, source, 0) == 201);
+	REQUIRE(server.files["/a"] == data);
+	REQUIRE(server.files["/b"].empty());
+	REQUIRE(server.connections == 1);
+}
+
+TEST_CASE("Test BuildCache upload() function", "")
+{
+	LocalServer server;
+	filesystem::create_directories("buildcache_test");
+	write_file("buildcache_test/staging.tar", "staging data");
+	write_file("buildcache_test/install.tar", "install data");
+	std::string dir = "/cache/ns/p/h1/";
+
+	BuildCache cache(server.url(), 2);
+	std::string error;
+
+	SECTION("Files are stored, and the package is only usable once they all are")
+	{
+		server.failures[dir + "install.tar"] = 1;
+		REQUIRE(cache.upload("ns/p/h1",
+		                     {{"staging.tar", "buildcache_test/staging.tar"},
+		                      {"install.tar", "buildcache_test/install.tar"}},
+		                     &error));
+		REQUIRE(server.stored ==
+		        std::vector<std::string>{dir + "staging.tar", dir + "install.tar",
+		                                 dir + "SHA256SUMS", dir + "usable"});
+		REQUIRE(server.files[dir + "install.tar"] == "install data");
+
+		// What is stored can be fetched again
+		filesystem::remove("buildcache_test/staging.tar");
+		REQUIRE(cache.fetch("ns/p/h1", {{"staging.tar", "buildcache_test/staging.tar"}},
+		                    &error));
+		REQUIRE(read_file("buildcache_test/staging.tar") == "staging data");
+	}
+
+	SECTION("Missing files are not stored")
+	{
+		REQUIRE(!cache.upload("ns/p/h1",
+		                      {{"staging.tar", "buildcache_test/staging.tar"},
+		                       {"output.info", "buildcache_test/output.info"}},
+		                      &error));
+		REQUIRE(error == "Could not read buildcache_test/output.info");
+		REQUIRE(server.files.count(dir + "usable") == 0);
+	}
+
+	filesystem::remove_all("buildcache_test");
+}
+
+TEST_CASE("Test CacheUploader uploads in the background", "")
+{
+	LocalServer server;
+	filesystem::create_directories("buildcache_test");
+	write_file("buildcache_test/file", "data");
+
+	BuildCache cache(server.url(), 2);
+	{
+		CacheUploader uploader(&cache, 2, 3);
+		for(int i = 0; i < 3; i++) {
+			REQUIRE(uploader.add("ns/p" + std::to_string(i) + "/h",
+			                     {{"staging.tar", "buildcache_test/file"}}));
+		}
+		// Packages already queued are not uploaded again
+		REQUIRE(uploader.add("ns/p0/h", {{"staging.tar", "buildcache_test/file"}}));
+		uploader.add("ns/missing/h", {{"staging.tar", "buildcache_test/missing"}});
+		uploader.finish();
+
+		REQUIRE(uploader.getUploaded() == 3);
+		REQUIRE(uploader.getFailed() + uploader.getDropped() == 1);
+		REQUIRE(!uploader.add("ns/late/h", {{"staging.tar", "buildcache_test/file"}}));
+	}
+	for(int i = 0; i < 3; i++) {
+		REQUIRE(server.files.count("/cache/ns/p" + std::to_string(i) + "/h/usable") == 1);
+		REQUIRE(server.files["/cache/ns/p" + std::to_string(i) + "/h/staging.tar"] ==
+		        "data");
+	}
+
+	filesystem::remove_all("buildcache_test");
+}
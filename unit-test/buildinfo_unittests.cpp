@@ -12,6 +12,7 @@ public:
 	{
 		// Reset the ignored features at the start of each test
 		BuildDescription::set_ignored_features({});
+		BuildDescription::set_hash_algorithm("");
 	}
 };
 
@@ -108,3 +109,29 @@ TEST_CASE_METHOD(BuildDescriptionTestsFixture, "Test add_extraction_info_file()
 	REQUIRE(buffer.str() ==
 	        "ExtractionInfoFile test_extraction_info_file test_hash_abc123\n");
 }
+
+TEST_CASE_METHOD(BuildDescriptionTestsFixture, "Test getFeatures() function", "")
+{
+	BuildDescription desc;
+	BuildDescription::set_ignored_features({"test_ignored"});
+
+	desc.add_feature_value("test_feature", "test_value");
+	desc.add_nil_feature_value("test_nil_feature");
+	desc.add_feature_value("test_ignored", "test_value");
+	desc.add_package_file("test_package_file", "test_hash_abc123");
+
+	REQUIRE(desc.getFeatures() ==
+	        std::vector<std::string>{"test_feature", "test_nil_feature"});
+}
+
+TEST_CASE_METHOD(BuildDescriptionTestsFixture, "Test set_hash_algorithm() function", "")
+{
+	BuildDescription desc;
+	desc.add_package_file("test_package_file", "test_hash_abc123");
+
+	BuildDescription::set_hash_algorithm("blake2b512");
+	std::stringstream buffer;
+	desc.print(buffer);
+	REQUIRE(buffer.str() == "HashAlgorithm blake2b512\n"
+	                        "PackageFile test_package_file test_hash_abc123\n");
+}
@@ -0,0 +1,78 @@
+#define CATCH_CONFIG_MAIN
+
+#include "dependencyorder.hpp"
+#include <algorithm>
+#include <catch2/catch.hpp>
+
+using namespace buildsys;
+
+//! Check every dependency comes before what depends on it
+static bool respects(const DependencyOrder &order,
+                     const std::vector<std::pair<size_t, size_t>> &dependencies)
+{
+	std::vector<size_t> ids = order.getOrder();
+	std::vector<size_t> position(ids.size());
+	for(size_t i = 0; i < ids.size(); i++) {
+		position[ids[i]] = i;
+	}
+	return std::all_of(dependencies.begin(), dependencies.end(),
+	                   [&position](const std::pair<size_t, size_t> &d) {
+		                   return position[d.second] < position[d.first];
+	                   });
+}
+
+TEST_CASE("Test DependencyOrder starts in id order", "")
+{
+	DependencyOrder order;
+	order.addVertex(2);
+	order.addVertex(3);
+	REQUIRE(order.getOrder() == std::vector<size_t>{0, 1, 2, 3});
+}
+
+TEST_CASE("Test DependencyOrder moves ids to satisfy new dependencies", "")
+{
+	DependencyOrder order;
+	order.addVertex(5);
+	std::vector<size_t> loop;
+	std::vector<std::pair<size_t, size_t>> dependencies{{0, 1}, {1, 2}, {3, 5}, {2, 4},
+	                                                    {5, 1}, {3, 0}};
+	std::vector<std::pair<size_t, size_t>> added;
+	for(auto &d : dependencies) {
+		REQUIRE(order.addDependency(d.first, d.second, &loop));
+		added.push_back(d);
+		REQUIRE(respects(order, added));
+	}
+
+	// Adding a dependency twice changes nothing
+	REQUIRE(order.addDependency(0, 1, &loop));
+	REQUIRE(respects(order, added));
+}
+
+TEST_CASE("Test DependencyOrder rejects dependency loops", "")
+{
+	DependencyOrder order;
+	order.addVertex(3);
+	std::vector<size_t> loop;
+	REQUIRE(order.addDependency(0, 1, &loop));
+	REQUIRE(order.addDependency(1, 2, &loop));
+	REQUIRE(order.addDependency(2, 3, &loop));
+
+	REQUIRE(!order.addDependency(3, 0, &loop));
+	REQUIRE(loop == std::vector<size_t>{3, 0, 1, 2, 3});
+	REQUIRE(!order.addDependency(1, 1, &loop));
+	REQUIRE(loop == std::vector<size_t>{1, 1});
+
+	// The rejected dependencies were not added
+	REQUIRE(respects(order, {{0, 1}, {1, 2}, {2, 3}}));
+	REQUIRE(order.addDependency(0, 3, &loop));
+}
+
+TEST_CASE("Test DependencyOrder clear() function", "")
+{
+	DependencyOrder order;
+	order.addVertex(3);
+	order.clear();
+	REQUIRE(order.getOrder().empty());
+	order.addVertex(0);
+	REQUIRE(order.getOrder() == std::vector<size_t>{0});
+}
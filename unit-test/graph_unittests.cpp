@@ -0,0 +1,350 @@
+#define CATCH_CONFIG_MAIN
+
+#include "include/buildsys.h"
+#include <catch2/catch.hpp>
+
+using namespace buildsys;
+
+class GraphTestsFixture
+{
+protected:
+	NameSpace *ns{nullptr};
+	BuildHistory history{"graph_test_history.db"};
+
+public:
+	GraphTestsFixture()
+	{
+		this->ns = NameSpace::findNameSpace("graph_test");
+		Package::set_build_history(&this->history);
+	}
+	~GraphTestsFixture()
+	{
+		Package::set_build_history(nullptr);
+		NameSpace::deleteAll();
+		filesystem::remove_all("output");
+		filesystem::remove("graph_test_history.db");
+	}
+
+	void set_build_time(Package *p, time_t secs)
+	{
+		BuildHistory::Record record;
+		record.outcome = "built";
+		record.total_ms = secs * 1000;
+		this->history.record("graph_test/" + p->getName(), record);
+	}
+
+	Package *add_package(const std::string &name)
+	{
+		this->ns->addPackage(std::make_unique<Package>(this->ns, name, "", ""));
+		return this->ns->findPackage(name);
+	}
+};
+
+TEST_CASE_METHOD(GraphTestsFixture, "Test scheduling of packages without dependencies", "")
+{
+	Package *a = this->add_package("a");
+	Package *b = this->add_package("b");
+
+	Internal_Graph graph;
+	graph.fill();
+	graph.prepareSchedule();
+
+	std::unordered_set<Package *> scheduled;
+	scheduled.insert(graph.topoNext());
+	scheduled.insert(graph.topoNext());
+	REQUIRE(graph.topoNext() == nullptr);
+	REQUIRE(scheduled == std::unordered_set<Package *>{a, b});
+}
+
+TEST_CASE_METHOD(GraphTestsFixture, "Test packages are only scheduled once dependencies are built", "")
+{
+	Package *top = this->add_package("top");
+	Package *left = this->add_package("left");
+	Package *right = this->add_package("right");
+	Package *bottom = this->add_package("bottom");
+	top->depend(left, false);
+	top->depend(right, false);
+	left->depend(bottom, false);
+	right->depend(bottom, false);
+
+	Internal_Graph graph;
+	graph.fill();
+	graph.prepareSchedule();
+
+	REQUIRE(graph.topoNext() == bottom);
+	REQUIRE(graph.topoNext() == nullptr);
+
+	graph.packageBuilt(bottom);
+	std::unordered_set<Package *> scheduled;
+	scheduled.insert(graph.topoNext());
+	scheduled.insert(graph.topoNext());
+	REQUIRE(graph.topoNext() == nullptr);
+	REQUIRE(scheduled == std::unordered_set<Package *>{left, right});
+
+	graph.packageBuilt(left);
+	REQUIRE(graph.topoNext() == nullptr);
+	graph.packageBuilt(right);
+	REQUIRE(graph.topoNext() == top);
+	REQUIRE(graph.topoNext() == nullptr);
+}
+
+TEST_CASE_METHOD(GraphTestsFixture, "Test packages on the longest path are scheduled first", "")
+{
+	Package *top = this->add_package("top");
+	Package *middle = this->add_package("middle");
+	Package *short_leaf = this->add_package("short_leaf");
+	Package *long_leaf = this->add_package("long_leaf");
+	top->depend(middle, false);
+	top->depend(long_leaf, false);
+	middle->depend(short_leaf, false);
+
+	this->set_build_time(middle, 50);
+	this->set_build_time(short_leaf, 5);
+	this->set_build_time(long_leaf, 20);
+
+	time_t secs = 0;
+	REQUIRE(middle->getPreviousBuildTime(&secs));
+	REQUIRE(secs == 50);
+	REQUIRE(!top->getPreviousBuildTime(&secs));
+
+	Internal_Graph graph;
+	graph.fill();
+	graph.prepareSchedule();
+
+	// short_leaf is quick to build, but gates the slow middle package
+	REQUIRE(graph.topoNext() == short_leaf);
+	REQUIRE(graph.topoNext() == long_leaf);
+	REQUIRE(graph.topoNext() == nullptr);
+
+	// top has no build time, so is assumed to take the average (25s)
+	REQUIRE(graph.remainingTime() == 80);
+	graph.packageBuilt(long_leaf);
+	REQUIRE(graph.remainingTime() == 80);
+	graph.packageBuilt(short_leaf);
+	REQUIRE(graph.remainingTime() == 75);
+	graph.packageBuilt(middle);
+	REQUIRE(graph.remainingTime() == 25);
+	graph.packageBuilt(top);
+	REQUIRE(graph.remainingTime() == 0);
+}
+
+TEST_CASE_METHOD(GraphTestsFixture, "Test staging release only schedules staging dependents", "")
+{
+	Package *top = this->add_package("top");
+	Package *middle = this->add_package("middle");
+	Package *bottom = this->add_package("bottom");
+	top->setDepsExtract("deps", false);
+	top->depend(middle, false);
+	middle->depend(bottom, false);
+
+	Internal_Graph graph;
+	graph.fill();
+	graph.prepareSchedule();
+
+	REQUIRE(graph.topoNext() == bottom);
+	REQUIRE(graph.topoNext() == nullptr);
+
+	// middle only needs the staging output of bottom
+	graph.packageStagingReleased(bottom);
+	REQUIRE(graph.topoNext() == middle);
+	REQUIRE(graph.topoNext() == nullptr);
+
+	// top extracts the install output of both, so waits for them to be built
+	graph.packageStagingReleased(middle);
+	REQUIRE(graph.topoNext() == nullptr);
+	graph.packageBuilt(middle);
+	REQUIRE(graph.topoNext() == nullptr);
+	graph.packageBuilt(bottom);
+	REQUIRE(graph.topoNext() == top);
+	REQUIRE(graph.topoNext() == nullptr);
+}
+
+TEST_CASE_METHOD(GraphTestsFixture, "Test packages that don't fit are passed over", "")
+{
+	Package *big = this->add_package("big");
+	Package *small = this->add_package("small");
+	Package *top = this->add_package("top");
+	top->depend(big, false);
+	top->depend(small, false);
+	big->setResources(16, 8192);
+
+	this->set_build_time(big, 100);
+	this->set_build_time(small, 1);
+
+	Internal_Graph graph;
+	graph.fill();
+	graph.prepareSchedule();
+
+	auto fits = [](Package *p) { return p->getResourceCores() <= 4; };
+
+	// big is on the longest path, but doesn't fit, so small goes first
+	REQUIRE(graph.topoNext(fits) == small);
+	REQUIRE(graph.topoNext(fits) == nullptr);
+	REQUIRE(graph.topoNext() == big);
+	REQUIRE(graph.topoNext() == nullptr);
+}
+
+TEST_CASE_METHOD(GraphTestsFixture, "Test local rebuilds are scheduled before resuming", "")
+{
+	Package *top = this->add_package("top");
+	Package *middle = this->add_package("middle");
+	Package *bottom = this->add_package("bottom");
+	top->depend(middle, true);
+	middle->depend(bottom, true);
+
+	Internal_Graph graph;
+	graph.fill();
+	graph.prepareSchedule();
+
+	// Packages depended on locally must be fully built first
+	REQUIRE(graph.topoNext() == bottom);
+	graph.packageStagingReleased(bottom);
+	REQUIRE(graph.topoNext() == nullptr);
+	graph.packageBuilt(bottom);
+	REQUIRE(graph.topoNext() == middle);
+	graph.packageBuilt(middle);
+	REQUIRE(graph.topoNext() == top);
+	REQUIRE(graph.localNext() == nullptr);
+
+	// top needs building, so middle and then bottom get rebuilt locally first
+	graph.packageNeedsLocalBuilds(top);
+	REQUIRE(graph.localNext() == bottom);
+	REQUIRE(graph.localNext() == nullptr);
+	REQUIRE(graph.topoNext() == nullptr);
+	graph.packageLocallyBuilt(bottom);
+	REQUIRE(graph.localNext() == middle);
+	REQUIRE(graph.topoNext() == nullptr);
+	graph.packageLocallyBuilt(middle);
+	REQUIRE(graph.localNext() == nullptr);
+	REQUIRE(graph.topoNext() == top);
+}
+
+TEST_CASE_METHOD(GraphTestsFixture, "Test packages are given dense ids", "")
+{
+	Package *a = this->add_package("a");
+	Package *b = this->add_package("b");
+
+	REQUIRE(a->getId() == 0);
+	REQUIRE(b->getId() == 1);
+	REQUIRE(NameSpace::packageCount() == 2);
+	REQUIRE(NameSpace::packageById(1) == b);
+}
+
+TEST_CASE_METHOD(GraphTestsFixture, "Test dependency loops are rejected", "")
+{
+	Package *a = this->add_package("a");
+	Package *b = this->add_package("b");
+	Package *c = this->add_package("c");
+	Package *d = this->add_package("d");
+	a->depend(b, false);
+	b->depend(c, false);
+	c->depend(d, false);
+
+	REQUIRE_THROWS_WITH(d->depend(b, false),
+	                    "Dependency Loop Detected: graph_test,d -> graph_test,b -> "
+	                    "graph_test,c -> graph_test,d");
+	REQUIRE(d->getDepends().empty());
+
+	// The order is ready without sorting, dependencies first
+	Internal_Graph graph;
+	graph.fill();
+	graph.prepareSchedule();
+	REQUIRE(graph.topoNext() == d);
+}
+
+TEST_CASE_METHOD(GraphTestsFixture, "Test closures follow intercept settings", "")
+{
+	Package *top = this->add_package("top");
+	Package *middle = this->add_package("middle");
+	Package *bottom = this->add_package("bottom");
+	top->depend(middle, false);
+	middle->depend(bottom, false);
+	top->setDepsExtract("deps", false);
+
+	auto staging_of = [](Package *p) {
+		std::unordered_set<Package *> packages;
+		p->getStagingClosure().for_each(
+		    [&packages](size_t id) { packages.insert(NameSpace::packageById(id)); });
+		return packages;
+	};
+	auto install_of = [](Package *p) {
+		std::unordered_set<Package *> packages;
+		p->getInstallPackages(&packages);
+		return packages;
+	};
+
+	{
+		Internal_Graph graph;
+		graph.fill();
+		graph.computeClosures();
+		REQUIRE(staging_of(top) == std::unordered_set<Package *>{middle, bottom});
+		REQUIRE(install_of(top) == std::unordered_set<Package *>{middle, bottom});
+		REQUIRE(top->getStagingClosure().count() == 2);
+		REQUIRE(bottom->getStagingClosure().empty());
+	}
+
+	// Intercepting packages hide their dependencies
+	middle->setIntercept(true, true);
+	Internal_Graph graph;
+	graph.fill();
+	graph.computeClosures();
+	REQUIRE(staging_of(top) == std::unordered_set<Package *>{middle});
+	REQUIRE(install_of(top) == std::unordered_set<Package *>{middle});
+	REQUIRE(staging_of(middle) == std::unordered_set<Package *>{bottom});
+}
+
+TEST_CASE_METHOD(GraphTestsFixture, "Test the packages affected by a change are found", "")
+{
+	Package *top = this->add_package("top");
+	Package *left = this->add_package("left");
+	Package *right = this->add_package("right");
+	Package *bottom = this->add_package("bottom");
+	top->depend(left, false);
+	top->depend(right, false);
+	left->depend(bottom, false);
+
+	Internal_Graph graph;
+	graph.fill();
+
+	auto affected_by = [&graph](const std::vector<Package *> &changed) {
+		std::unordered_set<Package *> packages;
+		graph.dependentClosure(changed).for_each(
+		    [&packages](size_t id) { packages.insert(NameSpace::packageById(id)); });
+		return packages;
+	};
+
+	REQUIRE(affected_by({bottom}) == std::unordered_set<Package *>{bottom, left, top});
+	REQUIRE(affected_by({right}) == std::unordered_set<Package *>{right, top});
+	REQUIRE(affected_by({right, left}) == std::unordered_set<Package *>{right, left, top});
+	REQUIRE(affected_by({}).empty());
+}
+
+TEST_CASE_METHOD(GraphTestsFixture, "Test packages are visited after their dependencies", "")
+{
+	std::vector<Package *> packages;
+	for(int i = 0; i < 20; i++) {
+		packages.push_back(this->add_package("p" + std::to_string(i)));
+	}
+	// A tree, with every package depending on its parent
+	for(size_t i = 1; i < packages.size(); i++) {
+		packages[i]->depend(packages[(i - 1) / 2], false);
+	}
+
+	Internal_Graph graph;
+	graph.fill();
+
+	std::mutex lock;
+	std::vector<Package *> visited;
+	bool in_order = true;
+	ThreadPool pool(4);
+	graph.forEachInOrder(&pool, [&lock, &visited, &in_order](Package *p) {
+		std::unique_lock<std::mutex> lk(lock);
+		for(auto &dp : p->getDepends()) {
+			auto it = std::find(visited.begin(), visited.end(), dp.getPackage());
+			in_order = in_order && (it != visited.end());
+		}
+		visited.push_back(p);
+	});
+	REQUIRE(in_order);
+	REQUIRE(visited.size() == packages.size());
+}
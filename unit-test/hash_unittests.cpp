@@ -2,9 +2,14 @@
 
 #include <filesystem>
 #include "hash.hpp"
+#include "hashcache.hpp"
 #include "packagecmd.hpp"
+#include "threadpool.hpp"
 #include <boost/format.hpp>
 #include <catch2/catch.hpp>
+#include <chrono>
+#include <fcntl.h>
+#include <unistd.h>
 
 using namespace buildsys;
 namespace filesystem = std::filesystem;
@@ -70,3 +75,190 @@ TEST_CASE_METHOD(HashTestsFixture, "Test hash_file() function for existent file"
 	std::string expected_hash = output.substr(0, output.find(' '));
 	REQUIRE(expected_hash == hash);
 }
+
+TEST_CASE_METHOD(HashTestsFixture, "Test Hasher matches hash_file()", "")
+{
+	std::string file_path = this->cwd + "/test_file.txt";
+	std::ofstream test_file;
+	test_file.open(file_path);
+	test_file << "This is some test data.\n";
+	test_file.close();
+
+	Hasher hasher;
+	hasher.update("This is some ", 13);
+	hasher.update("test data.\n", 11);
+	REQUIRE(hasher.finish() == hash_file(file_path));
+
+	Hasher empty;
+	REQUIRE(empty.finish() ==
+	        "e3b0c44298fc1c149afbf4c8996fb92427ae41e4649b934ca495991b7852b855");
+}
+
+TEST_CASE_METHOD(HashTestsFixture, "Test hash_file() uses the hash cache", "")
+{
+	std::string file_path = this->cwd + "/test_file.txt";
+	std::ofstream test_file(file_path);
+	test_file << "This is some test data.\n";
+	test_file.close();
+	std::string expected = hash_file(file_path);
+
+	HashCache cache(this->cwd + "/hash.db", 0);
+	cache.load();
+	hash_set_cache(&cache);
+	REQUIRE(hash_file(file_path) == expected);
+	REQUIRE(hash_file(file_path) == expected);
+	REQUIRE(hash_file(this->cwd + "/missing.txt").empty());
+	hash_set_cache(nullptr);
+
+	REQUIRE(cache.getMisses() == 1);
+	REQUIRE(cache.getHits() == 1);
+	REQUIRE(cache.size() == 1);
+}
+
+TEST_CASE_METHOD(HashTestsFixture, "Test hash_tree() matches find and sha256sum", "")
+{
+	std::string tree = this->cwd + "/tree";
+	filesystem::create_directories(tree + "/sub/deeper");
+	filesystem::create_directories(tree + "/empty");
+	for(std::string name : {"b", "A", "a_b", "a-c", ".hidden", "sub/x", "sub/deeper/y",
+	                        "with space", "back\\slash", "new\nline"}) {
+		std::ofstream out(tree + "/" + name);
+		out << "contents of " << name;
+	}
+	filesystem::create_symlink("b", tree + "/link");
+	filesystem::create_directory_symlink("sub", tree + "/sub_link");
+
+	std::string expected_path = this->cwd + "/expected";
+	std::string cmd = "cd " + tree + "; find -type f -exec sha256sum {} \\; | sort -k 2 " +
+	                  "> " + filesystem::absolute(expected_path).string();
+	REQUIRE(std::system(cmd.c_str()) == 0);
+	std::ifstream in(expected_path);
+	std::string expected((std::istreambuf_iterator<char>(in)), {});
+
+	ThreadPool pool(4);
+	for(ThreadPool *p : {static_cast<ThreadPool *>(nullptr), &pool}) {
+		std::ostringstream out;
+		REQUIRE(hash_tree(tree, p, out));
+		REQUIRE(out.str() == expected);
+	}
+}
+
+TEST_CASE_METHOD(HashTestsFixture, "Test hash_file() with other algorithms", "")
+{
+	std::string file_path = this->cwd + "/empty.txt";
+	std::ofstream(file_path).close();
+	const std::string sha256 =
+	    "e3b0c44298fc1c149afbf4c8996fb92427ae41e4649b934ca495991b7852b855";
+	const std::string blake2b512 =
+	    "786a02f742015903c6c6fd852552d272912f4740e15847618a86e217f71f5419"
+	    "d25e1031afee585313896444934eb04b903a685b1448b755d56f701afe9be2ce";
+
+	HashAlgorithm algorithm = HashAlgorithm::SHA256;
+	REQUIRE(hash_algorithm_from_name("blake2b512", &algorithm));
+	REQUIRE(algorithm == HashAlgorithm::BLAKE2b512);
+	REQUIRE(hash_algorithm_name(algorithm) == "blake2b512");
+	REQUIRE(!hash_algorithm_from_name("md5", &algorithm));
+
+	REQUIRE(hash_file(file_path, HashAlgorithm::BLAKE2b512) == blake2b512);
+	REQUIRE(hash_file(file_path) == sha256);
+
+	// Change detection uses the chosen algorithm, downloads are still checked with SHA256
+	hash_set_algorithm(HashAlgorithm::BLAKE2b512);
+	REQUIRE(hash_file(file_path) == blake2b512);
+	REQUIRE(hash_file(file_path, HashAlgorithm::SHA256) == sha256);
+	std::ostringstream out;
+	REQUIRE(hash_tree(this->cwd, nullptr, out));
+	REQUIRE(out.str() == blake2b512 + "  ./empty.txt\n");
+	hash_set_algorithm(HashAlgorithm::SHA256);
+}
+
+TEST_CASE_METHOD(HashTestsFixture, "Test hash_merkle() changes only with the contents", "")
+{
+	std::string tree = this->cwd + "/tree";
+	filesystem::create_directories(tree + "/sub");
+	std::ofstream(tree + "/a.txt") << "a\n";
+	std::ofstream(tree + "/sub/b.txt") << "b\n";
+	filesystem::create_symlink("a.txt", tree + "/link");
+
+	std::string original = hash_merkle(tree);
+	REQUIRE(original.length() == 64);
+	REQUIRE(hash_merkle(tree) == original);
+	REQUIRE(hash_merkle(tree + "/a.txt") == hash_file(tree + "/a.txt"));
+
+	// Rewriting a file with the same contents changes nothing
+	std::ofstream(tree + "/sub/b.txt") << "b\n";
+	REQUIRE(hash_merkle(tree) == original);
+
+	std::ofstream(tree + "/sub/b.txt") << "c\n";
+	std::string changed = hash_merkle(tree);
+	REQUIRE(changed != original);
+
+	filesystem::rename(tree + "/sub/b.txt", tree + "/sub/c.txt");
+	REQUIRE(hash_merkle(tree) != changed);
+	filesystem::rename(tree + "/sub/c.txt", tree + "/sub/b.txt");
+	REQUIRE(hash_merkle(tree) == changed);
+
+	filesystem::permissions(tree + "/a.txt", filesystem::perms::owner_exec,
+	                        filesystem::perm_options::add);
+	REQUIRE(hash_merkle(tree) != changed);
+	filesystem::permissions(tree + "/a.txt", filesystem::perms::owner_exec,
+	                        filesystem::perm_options::remove);
+
+	filesystem::remove(tree + "/link");
+	filesystem::create_symlink("sub", tree + "/link");
+	REQUIRE(hash_merkle(tree) != changed);
+
+	// The directory itself is followed when it is a link
+	filesystem::create_directory_symlink("tree", this->cwd + "/tree_link");
+	REQUIRE(hash_merkle(this->cwd + "/tree_link") == hash_merkle(tree));
+	REQUIRE(hash_merkle(this->cwd + "/missing").empty());
+}
+
+// Hidden, run with: hash_unittests "[benchmark]"
+TEST_CASE("Benchmark hash_file() throughput", "[.benchmark]")
+{
+	std::string file_path = "hash_benchmark.bin";
+	const size_t megabytes = 1024;
+	{
+		std::ofstream out(file_path, std::ios::binary);
+		std::vector<char> block(1024 * 1024);
+		for(size_t i = 0; i < block.size(); i++) {
+			block[i] = static_cast<char>(i * 131);
+		}
+		for(size_t i = 0; i < megabytes; i++) {
+			out.write(block.data(), static_cast<std::streamsize>(block.size()));
+		}
+	}
+
+	auto run = [&file_path, megabytes](const std::string &label) {
+		auto start = std::chrono::steady_clock::now();
+		REQUIRE(!hash_file(file_path).empty());
+		std::chrono::duration<double> secs = std::chrono::steady_clock::now() - start;
+		WARN(label << ": " << (static_cast<double>(megabytes) / 1024 / secs.count())
+		           << " GB/s");
+	};
+
+	// Drop the file from the page cache, so the first run reads it from disk
+	int fd = open(file_path.c_str(), O_RDONLY);
+	fdatasync(fd);
+	posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+	close(fd);
+	run("Cold cache");
+	run("Warm cache");
+	filesystem::remove(file_path);
+
+	// Many small files, as in a source tree, show the cost of each call
+	const size_t files = 10000;
+	filesystem::create_directories("hash_benchmark");
+	for(size_t i = 0; i < files; i++) {
+		std::ofstream out("hash_benchmark/" + std::to_string(i));
+		out << std::string(4096, static_cast<char>(i));
+	}
+	auto start = std::chrono::steady_clock::now();
+	for(size_t i = 0; i < files; i++) {
+		REQUIRE(!hash_file("hash_benchmark/" + std::to_string(i)).empty());
+	}
+	std::chrono::duration<double> secs = std::chrono::steady_clock::now() - start;
+	WARN("Small files: " << (static_cast<double>(files) / secs.count()) << " files/s");
+	filesystem::remove_all("hash_benchmark");
+}
@@ -0,0 +1,131 @@
+#define CATCH_CONFIG_MAIN
+
+#include "hashcache.hpp"
+#include <catch2/catch.hpp>
+#include <filesystem>
+#include <fstream>
+
+using namespace buildsys;
+namespace filesystem = std::filesystem;
+
+class HashCacheTestsFixture
+{
+protected:
+	std::string dir{"hashcache_test"};
+	std::string path{"hashcache_test/hash.db"};
+
+public:
+	HashCacheTestsFixture()
+	{
+		filesystem::create_directories(this->dir);
+	}
+	~HashCacheTestsFixture()
+	{
+		filesystem::remove_all(this->dir);
+	}
+
+	std::string write_file(const std::string &name, const std::string &data) const
+	{
+		std::string file = this->dir + "/" + name;
+		std::ofstream out(file);
+		out << data;
+		return file;
+	}
+
+	static struct stat stat_file(const std::string &file)
+	{
+		struct stat st = {};
+		REQUIRE(stat(file.c_str(), &st) == 0);
+		return st;
+	}
+};
+
+TEST_CASE_METHOD(HashCacheTestsFixture, "Test HashCache keeps digests across loads", "")
+{
+	std::string file = this->write_file("a", "data");
+	{
+		HashCache cache(this->path, 0);
+		cache.load();
+		std::string digest;
+		REQUIRE(!cache.find(stat_file(file), "sha256", &digest));
+		cache.record(file, stat_file(file), "sha256", "abc");
+		REQUIRE(cache.find(stat_file(file), "sha256", &digest));
+		REQUIRE(digest == "abc");
+		// Digests by other algorithms are kept apart
+		REQUIRE(!cache.find(stat_file(file), "blake2b512", &digest));
+		cache.record(file, stat_file(file), "blake2b512", "def");
+	}
+
+	HashCache cache(this->path, 0);
+	cache.load();
+	REQUIRE(cache.size() == 2);
+	std::string digest;
+	REQUIRE(cache.find(stat_file(file), "sha256", &digest));
+	REQUIRE(digest == "abc");
+	REQUIRE(cache.find(stat_file(file), "blake2b512", &digest));
+	REQUIRE(digest == "def");
+	REQUIRE(cache.getHits() == 2);
+	REQUIRE(cache.getMisses() == 0);
+}
+
+TEST_CASE_METHOD(HashCacheTestsFixture, "Test HashCache ignores changed files", "")
+{
+	std::string file = this->write_file("a", "data");
+	HashCache cache(this->path, 0);
+	cache.load();
+	cache.record(file, stat_file(file), "sha256", "abc");
+
+	this->write_file("a", "more data");
+	std::string digest;
+	REQUIRE(!cache.find(stat_file(file), "sha256", &digest));
+
+	// The same size and times, but a different file
+	struct stat st = stat_file(file);
+	cache.record(file, st, "sha256", "def");
+	st.st_ino++;
+	REQUIRE(!cache.find(st, "sha256", &digest));
+}
+
+TEST_CASE_METHOD(HashCacheTestsFixture, "Test HashCache skips files that just changed", "")
+{
+	std::string file = this->write_file("a", "data");
+	HashCache cache(this->path);
+	cache.load();
+	cache.record(file, stat_file(file), "sha256", "abc");
+	std::string digest;
+	REQUIRE(!cache.find(stat_file(file), "sha256", &digest));
+	REQUIRE(cache.size() == 0);
+}
+
+TEST_CASE_METHOD(HashCacheTestsFixture, "Test HashCache rewrites its file", "")
+{
+	std::string a = this->write_file("a", "data");
+	std::string b = this->write_file("b", "data");
+	{
+		HashCache cache(this->path, 0);
+		cache.load();
+		for(int i = 0; i < 2000; i++) {
+			cache.record(a, stat_file(a), "sha256", "abc");
+		}
+		cache.record(b, stat_file(b), "sha256", "def");
+	}
+	// Lines that can't be parsed are skipped
+	{
+		std::ofstream out(this->path, std::ios::app);
+		out << "12 34 garbage\n";
+	}
+	filesystem::remove(b);
+
+	{
+		HashCache cache(this->path, 0);
+		cache.load();
+		REQUIRE(cache.size() == 1);
+	}
+	std::ifstream in(this->path);
+	std::string line;
+	size_t lines = 0;
+	while(std::getline(in, line)) {
+		lines++;
+	}
+	REQUIRE(lines == 1);
+}
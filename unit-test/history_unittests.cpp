@@ -0,0 +1,122 @@
+#define CATCH_CONFIG_MAIN
+
+#include "history.hpp"
+#include <catch2/catch.hpp>
+#include <filesystem>
+#include <fstream>
+
+using namespace buildsys;
+namespace filesystem = std::filesystem;
+
+class HistoryTestsFixture
+{
+protected:
+	std::string path{"history_test.db"};
+
+public:
+	~HistoryTestsFixture()
+	{
+		filesystem::remove(this->path);
+	}
+
+	static BuildHistory::Record make_record(const std::string &hash,
+	                                        const std::string &outcome, int64_t total_ms)
+	{
+		BuildHistory::Record r;
+		r.hash = hash;
+		r.outcome = outcome;
+		r.total_ms = total_ms;
+		return r;
+	}
+};
+
+TEST_CASE_METHOD(HistoryTestsFixture, "Test BuildHistory records runs across loads", "")
+{
+	{
+		BuildHistory history(this->path);
+		history.load();
+		REQUIRE(history.size() == 0);
+
+		BuildHistory::Record r = make_record("abc", "built", 1500);
+		r.fetch_ms = 1;
+		r.prepare_ms = 2;
+		r.commands_ms = 3;
+		r.package_ms = 4;
+		r.cpu_ms = 5;
+		r.peak_rss_kb = 6;
+		r.bytes_written = 7;
+		history.record("ns/a", r);
+		history.record("ns/a", make_record("def", "current", 10));
+		history.record("ns/b", make_record("", "failed", 20));
+	}
+
+	BuildHistory history(this->path);
+	history.load();
+	REQUIRE(history.size() == 2);
+
+	// The latest run of a package that was built
+	BuildHistory::Record r;
+	REQUIRE(history.lastBuild("ns/a", &r));
+	REQUIRE(r.hash == "abc");
+	REQUIRE(r.total_ms == 1500);
+	REQUIRE(r.fetch_ms == 1);
+	REQUIRE(r.prepare_ms == 2);
+	REQUIRE(r.commands_ms == 3);
+	REQUIRE(r.package_ms == 4);
+	REQUIRE(r.cpu_ms == 5);
+	REQUIRE(r.peak_rss_kb == 6);
+	REQUIRE(r.bytes_written == 7);
+	REQUIRE(!history.lastBuild("ns/b", &r));
+	REQUIRE(!history.lastBuild("ns/c", &r));
+}
+
+TEST_CASE_METHOD(HistoryTestsFixture, "Test BuildHistory only keeps the latest runs", "")
+{
+	{
+		BuildHistory history(this->path);
+		for(int i = 0; i < 100; i++) {
+			history.record("ns/a", make_record(std::to_string(i), "built", i));
+		}
+		std::ofstream out(this->path, std::ios::app);
+		out << "a truncated line\n";
+	}
+
+	BuildHistory history(this->path);
+	history.load();
+
+	BuildHistory::Record r;
+	REQUIRE(history.lastBuild("ns/a", &r));
+	REQUIRE(r.total_ms == 99);
+
+	// The file has been compacted
+	std::ifstream in(this->path);
+	size_t lines = 0;
+	std::string line;
+	while(std::getline(in, line)) {
+		lines++;
+	}
+	REQUIRE(lines == BuildHistory::runs_kept);
+}
+
+TEST_CASE_METHOD(HistoryTestsFixture, "Test BuildHistory keeps the latest build of a package",
+                 "")
+{
+	{
+		BuildHistory history(this->path);
+		history.record("ns/a", make_record("abc", "built", 1500));
+		for(size_t i = 0; i < 4 * BuildHistory::runs_kept; i++) {
+			history.record("ns/a", make_record("abc", (i % 2 == 0) ? "current" : "cached", 10));
+		}
+
+		BuildHistory::Record r;
+		REQUIRE(history.lastBuild("ns/a", &r));
+		REQUIRE(r.total_ms == 1500);
+	}
+
+	BuildHistory history(this->path);
+	history.load();
+
+	BuildHistory::Record r;
+	REQUIRE(history.lastBuild("ns/a", &r));
+	REQUIRE(r.total_ms == 1500);
+}
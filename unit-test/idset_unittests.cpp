@@ -0,0 +1,58 @@
+#define CATCH_CONFIG_MAIN
+
+#include "idset.hpp"
+#include <catch2/catch.hpp>
+
+using namespace buildsys;
+
+static std::vector<size_t> ids(const IdSet &set)
+{
+	std::vector<size_t> result;
+	set.for_each([&result](size_t id) { result.push_back(id); });
+	return result;
+}
+
+TEST_CASE("Test IdSet insert() and contains() functions", "")
+{
+	IdSet set;
+	REQUIRE(set.empty());
+	REQUIRE(!set.contains(0));
+
+	set.insert(1000);
+	set.insert(3);
+	set.insert(64);
+	set.insert(3);
+
+	REQUIRE(!set.empty());
+	REQUIRE(set.count() == 3);
+	REQUIRE(set.contains(3));
+	REQUIRE(set.contains(64));
+	REQUIRE(set.contains(1000));
+	REQUIRE(!set.contains(4));
+	REQUIRE(!set.contains(65));
+	REQUIRE(!set.contains(5000));
+	REQUIRE(ids(set) == std::vector<size_t>{3, 64, 1000});
+}
+
+TEST_CASE("Test IdSet unite() function", "")
+{
+	IdSet a;
+	a.insert(1);
+	a.insert(200);
+
+	IdSet b;
+	b.insert(2);
+	b.insert(130);
+	b.insert(200);
+
+	a.unite(b);
+	REQUIRE(ids(a) == std::vector<size_t>{1, 2, 130, 200});
+
+	// Uniting with an empty set changes nothing
+	a.unite(IdSet());
+	REQUIRE(a.count() == 4);
+
+	IdSet c;
+	c.unite(a);
+	REQUIRE(ids(c) == ids(a));
+}
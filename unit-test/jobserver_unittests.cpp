@@ -0,0 +1,57 @@
+#define CATCH_CONFIG_MAIN
+
+#include "exceptions.hpp"
+#include "jobserver.hpp"
+#include <catch2/catch.hpp>
+#include <fcntl.h>
+
+using namespace buildsys;
+
+TEST_CASE("Test JobServer requires at least one job", "")
+{
+	REQUIRE_THROWS_AS(JobServer(0), CustomException);
+}
+
+TEST_CASE("Test JobServer makeFlags() function", "")
+{
+	JobServer js(4);
+
+	REQUIRE(js.getTokens() == 4);
+	REQUIRE(js.makeFlags().find("-j4 --jobserver-auth=") == 0);
+}
+
+TEST_CASE("Test JobServer pipe is not inherited by default", "")
+{
+	JobServer js(1);
+
+	REQUIRE((fcntl(js.getReadFd(), F_GETFD) & FD_CLOEXEC) != 0);
+	REQUIRE((fcntl(js.getWriteFd(), F_GETFD) & FD_CLOEXEC) != 0);
+}
+
+TEST_CASE("Test JobServer tokens can be acquired and released", "")
+{
+	JobServer js(2);
+
+	// Both tokens are available without waiting
+	js.acquire();
+	js.acquire();
+	js.release();
+	js.acquire();
+	js.release();
+	js.release();
+}
+
+TEST_CASE("Test JobToken returns its token when an exception is thrown", "")
+{
+	JobServer js(1);
+
+	try {
+		JobToken token(&js);
+		throw CustomException("build failed");
+	} catch(CustomException &e) {
+	}
+
+	// The only token is available again
+	JobToken token(&js);
+	JobToken none(nullptr);
+}
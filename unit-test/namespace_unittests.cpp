@@ -103,3 +103,21 @@ TEST_CASE_METHOD(NameSpaceTestsFixture, "Test addPackage() and findPackage()", "
 	REQUIRE(p->getName() == "test_package1");
 }
 
+TEST_CASE_METHOD(NameSpaceTestsFixture, "Test packages are given ids however they are created", "")
+{
+	NameSpace *ns = NameSpace::findNameSpace("test1");
+
+	filesystem::create_directories("package/found");
+	std::ofstream("package/found/found.lua").close();
+
+	ns->addPackage(std::make_unique<Package>(ns, "added", "", ""));
+	Package *found = ns->findPackage("found");
+	Package *added = ns->findPackage("added");
+
+	REQUIRE(NameSpace::packageCount() == 2);
+	REQUIRE(added->getId() == 0);
+	REQUIRE(found->getId() == 1);
+	REQUIRE(NameSpace::packageById(1) == found);
+
+	filesystem::remove_all("package");
+}
@@ -1,5 +1,6 @@
 #define CATCH_CONFIG_MAIN
 
+#include <fcntl.h>
 #include <filesystem>
 #include "packagecmd.hpp"
 #include <catch2/catch.hpp>
@@ -140,3 +141,61 @@ TEST_CASE_METHOD(PackageCmdTestsFixture,
 	bool ret = pc.Run(&logger);
 	REQUIRE(!ret);
 }
+
+TEST_CASE_METHOD(PackageCmdTestsFixture, "Test addMakeFlags() function", "")
+{
+	unsetenv("MAKEFLAGS");
+	PackageCmd pc("test_path", "test_app");
+	pc.addMakeFlags("-j4 --jobserver-auth=3,4");
+	REQUIRE(std::find(pc.getEnvp().begin(), pc.getEnvp().end(),
+	                  std::string("MAKEFLAGS=-j4 --jobserver-auth=3,4")) !=
+	        pc.getEnvp().end());
+
+	// Other commands are left alone
+	PackageCmd pc2("test_path", "test_app");
+	REQUIRE(std::find(pc2.getEnvp().begin(), pc2.getEnvp().end(),
+	                  std::string("MAKEFLAGS=-j4 --jobserver-auth=3,4")) ==
+	        pc2.getEnvp().end());
+}
+
+TEST_CASE_METHOD(PackageCmdTestsFixture, "Test addMakeFlags() appends to inherited MAKEFLAGS",
+                 "")
+{
+	setenv("MAKEFLAGS", "-k", 1);
+	PackageCmd pc("test_path", "test_app");
+	unsetenv("MAKEFLAGS");
+	pc.addMakeFlags("-j4 --jobserver-auth=3,4");
+
+	REQUIRE(std::count_if(pc.getEnvp().begin(), pc.getEnvp().end(),
+	                      [](const std::string &env) {
+		                      return env.compare(0, 10, "MAKEFLAGS=") == 0;
+	                      }) == 1);
+	REQUIRE(std::find(pc.getEnvp().begin(), pc.getEnvp().end(),
+	                  std::string("MAKEFLAGS=-k -j4 --jobserver-auth=3,4")) !=
+	        pc.getEnvp().end());
+}
+
+TEST_CASE_METHOD(PackageCmdTestsFixture, "Test inheritFd() passes on close-on-exec descriptors",
+                 "")
+{
+	int fds[2]; // NOLINT
+	REQUIRE(pipe2(fds, O_CLOEXEC) == 0);
+	std::string check = "test -e /proc/self/fd/" + std::to_string(fds[0]);
+	Logger logger;
+
+	PackageCmd closed(".", "/bin/sh");
+	closed.disableLogging();
+	closed.addArg("-c");
+	closed.addArg(check);
+	REQUIRE(!closed.Run(&logger));
+
+	PackageCmd inherited(".", "/bin/sh");
+	inherited.disableLogging();
+	inherited.addArg("-c");
+	inherited.addArg(check);
+	inherited.inheritFd(fds[0]);
+	REQUIRE(inherited.Run(&logger));
+
+	close(fds[0]);
+	close(fds[1]);
+}
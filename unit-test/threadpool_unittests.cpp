@@ -0,0 +1,104 @@
+#define CATCH_CONFIG_MAIN
+
+#include "threadpool.hpp"
+#include <catch2/catch.hpp>
+#include <future>
+#include <stdexcept>
+
+using namespace buildsys;
+
+TEST_CASE("Test ThreadPool runs all submitted tasks", "")
+{
+	ThreadPool pool(4);
+	std::atomic<int> count{0};
+
+	for(int i = 0; i < 1000; i++) {
+		pool.submit([&count] { count++; });
+	}
+	while(count != 1000) {
+		std::this_thread::yield();
+	}
+
+	REQUIRE(pool.size() == 4);
+	REQUIRE(count == 1000);
+	REQUIRE(pool.tasksRun() == 1000);
+	REQUIRE(pool.queueDepth() == 0);
+	REQUIRE(pool.maxQueueDepth() >= 1);
+}
+
+TEST_CASE("Test TaskGroup can wait for tasks from within a task", "")
+{
+	// A single worker must not deadlock waiting on tasks queued behind it
+	ThreadPool pool(1);
+	std::atomic<int> count{0};
+
+	TaskGroup outer(&pool);
+	for(int i = 0; i < 4; i++) {
+		outer.run([&pool, &count] {
+			TaskGroup inner(&pool);
+			for(int j = 0; j < 10; j++) {
+				inner.run([&count] { count++; });
+			}
+			inner.wait();
+		});
+	}
+	outer.wait();
+
+	REQUIRE(count == 40);
+}
+
+TEST_CASE("Test TaskGroup without a ThreadPool runs tasks immediately", "")
+{
+	int count = 0;
+
+	TaskGroup group(nullptr);
+	group.run([&count] { count++; });
+	REQUIRE(count == 1);
+	group.wait();
+}
+
+TEST_CASE("Test TaskGroup wait only runs tasks from its own group", "")
+{
+	ThreadPool pool(1);
+	std::promise<void> release;
+	std::shared_future<void> released = release.get_future().share();
+	std::promise<void> blocked;
+
+	// Keep the only worker busy so everything else stays queued
+	pool.submit([released, &blocked] {
+		blocked.set_value();
+		released.wait();
+	});
+	blocked.get_future().wait();
+
+	std::atomic<bool> unrelated_ran{false};
+	pool.submit([&unrelated_ran] { unrelated_ran = true; });
+
+	bool group_ran = false;
+	TaskGroup group(&pool);
+	group.run([&group_ran] { group_ran = true; });
+	group.wait();
+
+	REQUIRE(group_ran);
+	REQUIRE(!unrelated_ran);
+	release.set_value();
+}
+
+TEST_CASE("Test TaskGroup wait rethrows a task's exception", "")
+{
+	ThreadPool pool(2);
+	std::atomic<int> count{0};
+
+	TaskGroup group(&pool);
+	group.run([] { throw std::runtime_error("task failed"); });
+	for(int i = 0; i < 10; i++) {
+		group.run([&count] { count++; });
+	}
+	REQUIRE_THROWS_AS(group.wait(), std::runtime_error);
+	REQUIRE(count == 10);
+
+	// The group can still be used afterwards
+	group.run([&count] { count++; });
+	group.wait();
+	REQUIRE(count == 11);
+}
@@ -185,6 +185,45 @@ TEST_CASE_METHOD(TopLevelTestsFixture, "Test invalid 'hashoutput' function usage
 	REQUIRE(!p.isHashingOutput());
 }
 
+TEST_CASE_METHOD(TopLevelTestsFixture, "Test valid 'resources' function usage", "")
+{
+	Package p(this->ns, "test_package", ".", ".");
+
+	// Should default to one core and no memory
+	REQUIRE(p.getResourceCores() == 1);
+	REQUIRE(p.getResourceMemory() == 0);
+
+	REQUIRE(execute_lua(p, "resources({cores = 8, memory = 4096})"));
+	REQUIRE(p.getResourceCores() == 8);
+	REQUIRE(p.getResourceMemory() == 4096);
+
+	// Only the given resources should change
+	REQUIRE(execute_lua(p, "resources({memory = 512})"));
+	REQUIRE(p.getResourceCores() == 8);
+	REQUIRE(p.getResourceMemory() == 512);
+}
+
+TEST_CASE_METHOD(TopLevelTestsFixture, "Test invalid 'resources' function usage", "")
+{
+	Package p(this->ns, "test_package", ".", ".");
+
+	REQUIRE(!execute_lua(p, "resources()"));
+	REQUIRE(!execute_lua(p, "resources(4)"));
+	REQUIRE(!execute_lua(p, "resources({cores = 'many'})"));
+	REQUIRE(!execute_lua(p, "resources({disk = 100})"));
+	REQUIRE(!execute_lua(p, "resources({cores = 0})"));
+	REQUIRE(!execute_lua(p, "resources({cores = -2})"));
+	REQUIRE(!execute_lua(p, "resources({cores = 1.5})"));
+	REQUIRE(!execute_lua(p, "resources({cores = 0/0})"));
+	REQUIRE(!execute_lua(p, "resources({cores = 1e30})"));
+	REQUIRE(!execute_lua(p, "resources({memory = -1})"));
+	REQUIRE(!execute_lua(p, "resources({memory = 1/0})"));
+
+	// Should still be the defaults
+	REQUIRE(p.getResourceCores() == 1);
+	REQUIRE(p.getResourceMemory() == 0);
+}
+
 TEST_CASE_METHOD(TopLevelTestsFixture, "Test valid 'builddir' function usage (no parameter)", "")
 {
 	Package p(this->ns, "test_package", ".", ".");
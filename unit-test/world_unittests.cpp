@@ -0,0 +1,51 @@
+#define CATCH_CONFIG_MAIN
+
+#include "include/buildsys.h"
+#include <catch2/catch.hpp>
+
+using namespace buildsys;
+
+class WorldTestsFixture
+{
+public:
+	WorldTestsFixture()
+	{
+		hash_setup();
+	}
+	~WorldTestsFixture()
+	{
+		Package::set_thread_pool(nullptr);
+		Package::set_staging_released_hook(nullptr);
+		NameSpace::deleteAll();
+		hash_shutdown();
+		filesystem::remove_all("package");
+		filesystem::remove_all("output");
+		filesystem::remove("loop.lua");
+	}
+
+	/**
+	 * Write the lua file for a package found by depend().
+	 *
+	 * @param name - The name of the package.
+	 * @param lua_code - The contents of the file.
+	 */
+	static void write_package(const std::string &name, const std::string &lua_code)
+	{
+		filesystem::create_directories("package/" + name);
+		std::ofstream("package/" + name + "/" + name + ".lua") << lua_code;
+	}
+};
+
+TEST_CASE_METHOD(WorldTestsFixture, "Test basePackage() fails on a dependency loop", "")
+{
+	std::ofstream("loop.lua") << "depend('a')\n";
+	write_package("a", "depend('b')\n");
+	write_package("b", "depend('c')\n");
+	write_package("c", "depend('a')\n");
+
+	World world;
+	world.setParseOnly();
+
+	REQUIRE(!world.basePackage("loop.lua"));
+	REQUIRE(world.isFailed());
+}